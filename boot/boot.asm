@@ -1,12 +1,16 @@
 ; boot.asm
 ; a very simple bootloader for aceos.
-; this bootloader prints "bootloader loaded. welcome to aceos!" to the screen.
+; this bootloader collects the bios e820 memory map for the kernel, then
 ; it loads a c kernel and switches to 32-bit protected mode before jumping to it.
 
 bits 16             ; we are in 16-bit real mode
 
 ORG 0x7C00          ; bios loads our bootloader at this address
 
+KERNEL_SECTORS equ 256  ; sectors to load for the kernel (128KB at 0x10000)
+E820_MAP equ 0x5000     ; memory map for the kernel: dword count, then 24-byte entries
+E820_MAX_ENTRIES equ 32
+
 start:              ; start of bootloader code
     cli             ; disable interrupts initially
     xor ax, ax      ; zero ax
@@ -24,8 +28,33 @@ start:              ; start of bootloader code
     ; disable hardware cursor
     call disable_cursor
 
-    ; print the welcome message
-    mov si, message ; point si to our message
+detect_memory:
+    ; collect the BIOS INT 15h E820 memory map at E820_MAP (es = 0)
+    xor ebx, ebx    ; continuation value, 0 = first entry
+    xor bp, bp      ; entries stored
+    mov di, E820_MAP + 4
+e820_next:
+    mov eax, 0xE820
+    mov ecx, 24
+    mov edx, 0x534D4150 ; 'SMAP'
+    mov dword [di + 20], 1 ; valid ACPI 3.0 attributes if the BIOS fills only 20 bytes
+    int 0x15
+    jc e820_done    ; carry set: unsupported, or past the last entry
+    cmp eax, 0x534D4150
+    jne e820_done
+    mov ecx, [di + 8]   ; 64-bit region length: ecx only held the byte count
+    or ecx, [di + 12]   ; the BIOS returned, so test both dwords of the entry
+    jz e820_skip    ; ignore empty entries
+    inc bp
+    add di, 24
+    cmp bp, E820_MAX_ENTRIES
+    je e820_done
+e820_skip:
+    test ebx, ebx   ; ebx = 0 after the last entry
+    jnz e820_next
+e820_done:
+    mov [E820_MAP], bp
+    mov word [E820_MAP + 2], 0
 
 load_kernel:
     ; print kernel loading message
@@ -39,20 +68,37 @@ load_kernel:
     jc disk_error   ; if carry flag is set, error occurred
     
     ; load the kernel (from sector 2, right after bootloader)
-    mov ah, 0x02    ; BIOS read sector function
-    mov al, 120     ; number of sectors to read (60KB, should be enough for enhanced kernel)
-    xor ch, ch      ; cylinder 0
-    mov cl, 2       ; sector 2 (sectors are 1-based, sector 1 is bootloader)
-    xor dh, dh      ; head 0
-    xor dl, dl      ; drive 0 (floppy)
-    
-    ; set buffer where to load the kernel
+    ; one sector at a time so the image can span tracks and 64KB boundaries
     mov bx, 0x1000  ; load kernel to segment 0x1000
     mov es, bx
     xor bx, bx      ; offset 0 in segment - so address 0x10000
+    mov si, 1       ; LBA of first kernel sector
+    mov di, KERNEL_SECTORS
+
+read_kernel_sector:
+    ; convert LBA in si to CHS (18 sectors per track, 2 heads)
+    mov ax, si
+    xor dx, dx
+    mov cx, 18
+    div cx          ; ax = track index, dx = sector - 1
+    mov cl, dl
+    inc cl          ; sector (1-based)
+    mov dh, al
+    and dh, 1       ; head = track index % 2
+    shr ax, 1
+    mov ch, al      ; cylinder = track index / 2
+    xor dl, dl      ; drive 0 (floppy)
 
+    mov ax, 0x0201  ; BIOS read sector function, 1 sector
     int 0x13        ; call BIOS disk read
     jc disk_error   ; if carry flag is set, error occurred
+
+    mov ax, es
+    add ax, 0x20    ; advance buffer by 512 bytes
+    mov es, ax
+    inc si
+    dec di
+    jnz read_kernel_sector
     
     ; print kernel loaded message
     mov si, kernel_loaded_msg
@@ -150,9 +196,6 @@ halt_system:
     hlt             ; halt the processor
     jmp halt_system ; in case of interrupt, halt again
 
-message:
-    db "Bootloader loaded. Welcome to aceOS!", 13, 10, 0 ; with CR+LF
-
 kernel_loading_msg:
     db "Loading kernel...", 13, 10, 0
 
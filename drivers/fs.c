@@ -2,6 +2,7 @@
 #include "../include/libc/string.h"
 #include "../include/libc/stdio.h"
 #include "../include/libc/stdlib.h"
+#include "../include/memory.h"
 #include "../include/serial.h"
 
 // Global filesystem instance
@@ -306,7 +307,7 @@ int fs_create(const char* path, uint32_t size) {
     // Allocate memory for file data
     void* data_ptr = NULL;
     if (size > 0) {
-        data_ptr = malloc(size);
+        data_ptr = heap_malloc_tagged(size, HEAP_TAG_FS);
         if (data_ptr == NULL) {
             debug_println("Failed to allocate memory for file");
             return -1;
@@ -384,7 +385,7 @@ int fs_delete(const char* path) {
     } else {
         // Free file data memory
         if (fs.files[file_idx].data_pointer != 0) {
-            free((void*)fs.files[file_idx].data_pointer);
+            heap_free((void*)fs.files[file_idx].data_pointer);
         }
     }
     
@@ -429,13 +430,13 @@ int fs_write(const char* path, const void* data, uint32_t size) {
     
     // If the file already has data and the size is different, free the old data
     if (fs.files[file_idx].data_pointer != 0 && fs.files[file_idx].size != size) {
-        free((void*)fs.files[file_idx].data_pointer);
+        heap_free((void*)fs.files[file_idx].data_pointer);
         fs.files[file_idx].data_pointer = 0;
     }
     
     // Allocate new memory if needed
     if (fs.files[file_idx].data_pointer == 0) {
-        void* data_ptr = malloc(size);
+        void* data_ptr = heap_malloc_tagged(size, HEAP_TAG_FS);
         if (data_ptr == NULL) {
             debug_println("Failed to allocate memory for file");
             return -1;
@@ -815,7 +816,7 @@ int fs_copy(const char* src_path, const char* dest_path) {
     
     // Copy data if source has data
     if (fs.files[src_idx].data_pointer != 0 && fs.files[src_idx].size > 0) {
-        void* data = malloc(fs.files[src_idx].size);
+        void* data = heap_malloc_tagged(fs.files[src_idx].size, HEAP_TAG_FS);
         if (data == NULL) {
             debug_println("Failed to allocate memory for copy");
             fs_delete(dest_path);
@@ -828,7 +829,7 @@ int fs_copy(const char* src_path, const char* dest_path) {
         // Write to destination
         result = fs_write(dest_path, data, fs.files[src_idx].size);
         
-        free(data);
+        heap_free(data);
         
         if (result != 0) {
             debug_println("Failed to write to destination file");
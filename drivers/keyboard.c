@@ -1,6 +1,8 @@
 #include "keyboard.h"
 #include "io.h"
 #include "pic.h"
+#include "sync.h"
+#include "cpu.h"
 
 // Keyboard buffer size
 #define KEYBOARD_BUFFER_SIZE 256
@@ -10,6 +12,9 @@ static char keyboard_buffer[KEYBOARD_BUFFER_SIZE];
 static uint32_t buffer_head = 0;
 static uint32_t buffer_tail = 0;
 
+// Processes sleeping in keyboard_getchar
+static wait_queue_t keyboard_waiters = {NULL, NULL};
+
 // Key state
 static uint8_t shift_pressed = 0;
 static uint8_t caps_lock_on = 0;
@@ -97,6 +102,7 @@ void keyboard_handler(registers_t regs) {
             // If we got a valid character, add it to the buffer
             if (character) {
                 keyboard_buffer_push(character);
+                wait_queue_wake_all(&keyboard_waiters);
             }
         }
     }
@@ -147,14 +153,16 @@ uint8_t keyboard_buffer_empty() {
 char keyboard_getchar() {
     char c;
     
-    // Wait until a key is available
+    // Sleep until the interrupt handler queues a key; interrupts stay off
+    // between the check and the sleep so a key cannot slip in unseen
+    uint32_t flags = irq_save();
     while (keyboard_buffer_empty()) {
-        // This is a busy wait, which is not ideal but simple
-        // A more advanced system would use a semaphore or similar synchronization
+        wait_queue_sleep(&keyboard_waiters);
     }
     
     // Get the next character
     c = keyboard_buffer_pop();
+    irq_restore(flags);
     
     return c;
 } 
\ No newline at end of file
@@ -4,18 +4,33 @@
 #include "../include/serial.h"
 #include "../include/process.h"
 #include "../include/utils.h"
+#include "../include/cpu.h"
+#include "../include/pic.h"
 
 // Global timer state
 uint32_t timer_ticks = 0;
 system_time_t system_time = {0, 0, 0, 0};
-static timer_stats_t stats = {0, 0, 0, 0};
+static timer_stats_t stats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
 static uint32_t measurement_start = 0;
+static uint32_t interrupts_at_second = 0;
+
+// Tickless idle: while non-zero the PIT is in one-shot mode and will fire
+// once, this many ticks after the last periodic interrupt
+static uint32_t tickless_ticks = 0;
+static uint32_t tickless_first_count = 0;  // Counts left in the tick we stopped in
+static uint32_t tickless_count = 0;        // Count loaded for the one-shot
 
 // Timer callbacks (simple array for now)
 #define MAX_TIMER_CALLBACKS 10
 static timer_callback_t timer_callbacks[MAX_TIMER_CALLBACKS];
 static int callback_count = 0;
 
+// Sleeping processes, hashed by wake tick. The inner wheel holds the next
+// 256 ticks one slot per tick; the outer wheel holds 256-tick blocks and
+// each slot is cascaded inward when its block begins
+static process_t* wheel_inner[TIMER_WHEEL_SIZE];
+static process_t* wheel_outer[TIMER_WHEEL_OUTER_SIZE];
+
 // Initialize the timer
 void timer_init(void) {
     serial_write_string("Initializing system timer...\n");
@@ -31,6 +46,11 @@ void timer_init(void) {
     stats.interrupts_per_second = 0;
     stats.missed_ticks = 0;
     stats.scheduler_calls = 0;
+    stats.wakeups = 0;
+    stats.cascades = 0;
+    stats.interrupts = 0;
+    stats.tickless_entries = 0;
+    stats.skipped_ticks = 0;
     
     // Clear callbacks
     for (int i = 0; i < MAX_TIMER_CALLBACKS; i++) {
@@ -49,27 +69,259 @@ void timer_init(void) {
 void timer_set_frequency(uint32_t frequency) {
     // Calculate divisor for PIT
     // PIT input clock is 1193180 Hz
-    uint32_t divisor = 1193180 / frequency;
+    uint32_t divisor = PIT_BASE_FREQUENCY / frequency;
     
-    // Send command byte to PIT
-    outb(TIMER_COMMAND_PORT, PIT_CHANNEL_0 | PIT_ACCESS_LOHIBYTE | PIT_MODE_SQUARE_WAVE);
+    // Send command byte to PIT; the rate generator counts down one per
+    // input clock, so the position within a tick can be read back
+    outb(TIMER_COMMAND_PORT, PIT_CHANNEL_0 | PIT_ACCESS_LOHIBYTE | PIT_MODE_RATE_GENERATOR);
     
     // Send frequency divisor (low byte first, then high byte)
     outb(TIMER_DATA_PORT_0, divisor & 0xFF);
     outb(TIMER_DATA_PORT_0, (divisor >> 8) & 0xFF);
 }
 
-// Timer interrupt handler
-void timer_handler(registers_t regs) {
+// Link a sleeper into the slot covering its wake tick; O(1)
+static void timer_wheel_insert(process_t* process) {
+    uint32_t delta = process->wake_tick - timer_ticks;
+    uint32_t block = timer_ticks >> TIMER_WHEEL_BITS;
+    uint32_t wake_block = process->wake_tick >> TIMER_WHEEL_BITS;
+    uint32_t blocks_ahead = (wake_block - block) & (0xFFFFFFFF >> TIMER_WHEEL_BITS); // Across tick wrap
+    process_t** slot;
+    
+    if (delta < TIMER_WHEEL_SIZE) {
+        slot = &wheel_inner[process->wake_tick & (TIMER_WHEEL_SIZE - 1)];
+    } else if (blocks_ahead < TIMER_WHEEL_OUTER_SIZE) {
+        slot = &wheel_outer[wake_block & (TIMER_WHEEL_OUTER_SIZE - 1)];
+    } else {
+        // Beyond the outer wheel: park in the slot cascaded last, re-hash then
+        slot = &wheel_outer[(block - 1) & (TIMER_WHEEL_OUTER_SIZE - 1)];
+    }
+    
+    process->sleep_prev = NULL;
+    process->sleep_next = *slot;
+    if (*slot) {
+        (*slot)->sleep_prev = process;
+    }
+    *slot = process;
+    process->sleep_slot = slot;
+}
+
+// Unlink a sleeper from its slot; O(1)
+static void timer_wheel_remove(process_t* process) {
+    if (process->sleep_prev) {
+        process->sleep_prev->sleep_next = process->sleep_next;
+    } else {
+        *process->sleep_slot = process->sleep_next;
+    }
+    
+    if (process->sleep_next) {
+        process->sleep_next->sleep_prev = process->sleep_prev;
+    }
+    
+    process->sleep_next = NULL;
+    process->sleep_prev = NULL;
+    process->sleep_slot = NULL;
+}
+
+// Advance the wheel to timer_ticks: cascade at block boundaries, then
+// wake everything in the current inner slot
+static void timer_wheel_advance(void) {
+    if ((timer_ticks & (TIMER_WHEEL_SIZE - 1)) == 0) {
+        process_t** outer = &wheel_outer[(timer_ticks >> TIMER_WHEEL_BITS) & (TIMER_WHEEL_OUTER_SIZE - 1)];
+        process_t* process = *outer;
+        *outer = NULL;
+        
+        while (process) {
+            process_t* next = process->sleep_next;
+            timer_wheel_insert(process);
+            stats.cascades++;
+            process = next;
+        }
+    }
+    
+    process_t** slot = &wheel_inner[timer_ticks & (TIMER_WHEEL_SIZE - 1)];
+    while (*slot) {
+        process_t* process = *slot;
+        timer_wheel_remove(process);
+        scheduler_wake(process);
+        stats.wakeups++;
+    }
+}
+
+// One tick of timekeeping: the tick count, sleepers and the wall clock
+static void timer_advance(void) {
     timer_ticks++;
     stats.total_ticks++;
     
+    timer_wheel_advance();
+    
     // Update system time every 1000 ticks (1 second at 1000 Hz)
     if (timer_ticks % 1000 == 0) {
         timer_update_system_time();
-        stats.interrupts_per_second = 1000; // We know it's 1000 Hz
+        stats.interrupts_per_second = stats.interrupts - interrupts_at_second;
+        interrupts_at_second = stats.interrupts;
+    }
+}
+
+// Account for ticks that passed without an interrupt
+static void timer_catch_up(uint32_t ticks) {
+    for (uint32_t i = 0; i < ticks; i++) {
+        timer_advance();
+    }
+    stats.skipped_ticks += ticks;
+    
+    if (is_multitasking_enabled()) {
+        scheduler_account_ticks(ticks);
+    }
+}
+
+// Read the channel 0 counter
+static uint32_t timer_read_count(void) {
+    outb(TIMER_COMMAND_PORT, PIT_CHANNEL_0 | PIT_LATCH_COUNT);
+    uint32_t low = inb(TIMER_DATA_PORT_0);
+    uint32_t high = inb(TIMER_DATA_PORT_0);
+    return (high << 8) | low;
+}
+
+// Ticks until the next sleeper is due, up to max; 0 if none is
+static uint32_t timer_next_deadline(uint32_t max) {
+    // A sleeper in the next outer slot may be due right after the cascade
+    uint32_t to_boundary = TIMER_WHEEL_SIZE - (timer_ticks & (TIMER_WHEEL_SIZE - 1));
+    uint32_t next_block = ((timer_ticks >> TIMER_WHEEL_BITS) + 1) & (TIMER_WHEEL_OUTER_SIZE - 1);
+    if (to_boundary <= max && wheel_outer[next_block]) {
+        max = to_boundary;
+    }
+    
+    for (uint32_t ticks = 1; ticks <= max; ticks++) {
+        if (wheel_inner[(timer_ticks + ticks) & (TIMER_WHEEL_SIZE - 1)]) {
+            return ticks;
+        }
+    }
+    return 0;
+}
+
+// Switch the PIT to a one-shot that fires after first counts plus
+// ticks - 1 whole ticks, ending on a tick boundary
+static void timer_oneshot(uint32_t ticks, uint32_t first) {
+    tickless_first_count = first;
+    tickless_count = first + (ticks - 1) * PIT_TICK_COUNT;
+    tickless_ticks = ticks;
+    
+    outb(TIMER_COMMAND_PORT, PIT_CHANNEL_0 | PIT_ACCESS_LOHIBYTE | PIT_MODE_ONESHOT);
+    outb(TIMER_DATA_PORT_0, tickless_count & 0xFF);
+    outb(TIMER_DATA_PORT_0, (tickless_count >> 8) & 0xFF);
+}
+
+// Stop the periodic tick and arm a one-shot for the next deadline.
+// Called with interrupts off
+static void timer_tickless_enter(void) {
+    if (tickless_ticks) {
+        return; // Already running out a one-shot
+    }
+    
+    // Callbacks expect every tick, and ready processes need preempting
+    if (callback_count > 0 || scheduler_ready_count() > 0) {
+        return;
     }
     
+    uint32_t ticks = timer_next_deadline(TIMER_TICKLESS_MAX_TICKS);
+    if (ticks == 0) {
+        ticks = TIMER_TICKLESS_MAX_TICKS;
+    }
+    if (ticks < 2) {
+        return; // Nothing to save
+    }
+    
+    // Finish the current tick, then whole ticks up to the deadline
+    uint32_t first = timer_read_count();
+    if (first == 0 || first > PIT_TICK_COUNT) {
+        return;
+    }
+    
+    timer_oneshot(ticks, first);
+    stats.tickless_entries++;
+    
+    // A periodic tick that latched in the PIC before the switch would be
+    // taken for the one-shot; go back to periodic and let it through
+    if (irq_pending(0)) {
+        tickless_ticks = 0;
+        timer_set_frequency(TIMER_FREQUENCY);
+    }
+}
+
+// Whether the armed one-shot has counted past zero
+static int timer_oneshot_expired(uint32_t count) {
+    return count == 0 || count > tickless_count;
+}
+
+// The one-shot has not expired yet: account for the whole ticks it has
+// run, then re-arm it for the rest of the current tick so the periodic
+// tick resumes in phase and the partial tick is not lost
+static void timer_tickless_resync(uint32_t count) {
+    uint32_t elapsed = tickless_count - count;
+    uint32_t ticks = 0;
+    uint32_t remaining = tickless_first_count - elapsed;
+    
+    if (elapsed >= tickless_first_count) {
+        uint32_t into_tick = (elapsed - tickless_first_count) % PIT_TICK_COUNT;
+        ticks = 1 + (elapsed - tickless_first_count) / PIT_TICK_COUNT;
+        remaining = PIT_TICK_COUNT - into_tick;
+    }
+    
+    timer_oneshot(1, remaining);
+    timer_catch_up(ticks);
+}
+
+// Woken early by another interrupt: account for the ticks that passed.
+// Called with interrupts off
+static void timer_tickless_exit(void) {
+    if (!tickless_ticks) {
+        return; // The one-shot fired and timer_handler already caught up
+    }
+    
+    // A count past zero means the one-shot interrupt is pending; let
+    // timer_handler take it
+    uint32_t count = timer_read_count();
+    if (timer_oneshot_expired(count)) {
+        return;
+    }
+    
+    timer_tickless_resync(count);
+}
+
+// Halt until the next interrupt. With nothing else ready the periodic
+// tick is switched off and the PIT fires once, at the next sleeper's
+// deadline, instead of every millisecond
+void timer_idle(void) {
+    uint32_t flags = irq_save();
+    timer_tickless_enter();
+    asm volatile ("sti; hlt");
+    asm volatile ("cli");
+    timer_tickless_exit();
+    irq_restore(flags);
+}
+
+// Timer interrupt handler
+void timer_handler(registers_t regs) {
+    stats.interrupts++;
+    
+    // End of a tickless stretch: the ticks before this one passed silently.
+    // Only trust that once the PIT confirms the one-shot ran out; otherwise
+    // this is a periodic tick that was already pending when it was armed
+    if (tickless_ticks) {
+        uint32_t count = timer_read_count();
+        if (timer_oneshot_expired(count)) {
+            uint32_t skipped = tickless_ticks - 1;
+            tickless_ticks = 0;
+            timer_set_frequency(TIMER_FREQUENCY);
+            timer_catch_up(skipped);
+        } else {
+            timer_tickless_resync(count);
+        }
+    }
+    
+    timer_advance();
+    
     // Call registered callbacks
     for (int i = 0; i < callback_count; i++) {
         if (timer_callbacks[i]) {
@@ -89,18 +341,38 @@ uint32_t timer_get_ticks(void) {
     return timer_ticks;
 }
 
-// Sleep for specified milliseconds
+// Sleep for at least the given number of milliseconds. The caller blocks
+// in the timer wheel and other processes (or the idle thread) run
 void timer_sleep(uint32_t milliseconds) {
-    uint32_t start_ticks = timer_ticks;
-    uint32_t target_ticks = start_ticks + milliseconds;
-    
-    // Busy wait (not ideal, but simple)
-    while (timer_ticks < target_ticks) {
-        // Yield to other processes if multitasking is enabled
-        if (is_multitasking_enabled()) {
-            scheduler_yield();
+    if (milliseconds == 0) {
+        return;
+    }
+    
+    // Without a scheduler, or on the idle thread, there is nothing to switch
+    // to; never leave a process that cannot block linked into the wheel
+    if (!is_multitasking_enabled() || !scheduler_can_block()) {
+        uint32_t target_ticks = timer_ticks + milliseconds;
+        while ((int32_t)(target_ticks - timer_ticks) > 0) {
+            asm volatile ("hlt");
         }
+        return;
+    }
+    
+    // Queue and block with interrupts off so the wakeup cannot be missed
+    uint32_t flags = irq_save();
+    current_process->wake_tick = timer_ticks + milliseconds;
+    timer_wheel_insert(current_process);
+    scheduler_block();
+    irq_restore(flags);
+}
+
+// Take a process out of the wheel before it is destroyed
+void timer_cancel_sleep(process_t* process) {
+    uint32_t flags = irq_save();
+    if (process->sleep_slot) {
+        timer_wheel_remove(process);
     }
+    irq_restore(flags);
 }
 
 // Update system time based on timer ticks
@@ -163,6 +435,30 @@ void timer_print_stats(void) {
     serial_write_string(buffer);
     serial_write_string("\n");
     
+    serial_write_string("Timer interrupts: ");
+    itoa(stats.interrupts, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" (last second: ");
+    itoa(stats.interrupts_per_second, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(")\n");
+    
+    serial_write_string("Tickless idle entries: ");
+    itoa(stats.tickless_entries, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(", ticks skipped: ");
+    itoa(stats.skipped_ticks, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("\n");
+    
+    serial_write_string("Sleep wakeups: ");
+    itoa(stats.wakeups, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(", cascades: ");
+    itoa(stats.cascades, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("\n");
+    
     serial_write_string("Registered callbacks: ");
     itoa(callback_count, buffer, 10);
     serial_write_string(buffer);
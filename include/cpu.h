@@ -9,4 +9,62 @@ void enable_interrupts();
 // Get ESP register value
 uint32_t get_esp();
 
+// Disable interrupts, returning the previous EFLAGS for irq_restore
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    asm volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+// Re-enable interrupts if they were on when irq_save was called
+static inline void irq_restore(uint32_t flags) {
+    if (flags & 0x200) {
+        asm volatile ("sti" : : : "memory");
+    }
+}
+
+// Faulting linear address of the last page fault
+static inline uint32_t read_cr2(void) {
+    uint32_t addr;
+    asm volatile ("mov %%cr2, %0" : "=r"(addr));
+    return addr;
+}
+
+// CPUID leaf 1 EDX feature bits
+#define CPUID_FEAT_EDX_PSE  0x00000008  // 4MB pages
+#define CPUID_FEAT_EDX_PGE  0x00002000  // Global pages
+
+// CR4 control bits
+#define CR4_PSE             0x00000010
+#define CR4_PGE             0x00000080
+
+// Execute CPUID for a leaf
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile ("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+// Leaf 1 EDX feature flags
+static inline uint32_t cpu_features_edx(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return edx;
+}
+
+static inline uint32_t read_cr4(void) {
+    uint32_t value;
+    asm volatile ("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr4(uint32_t value) {
+    asm volatile ("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+// Read the CPU time-stamp counter
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile ("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
 #endif 
\ No newline at end of file
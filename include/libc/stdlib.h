@@ -8,6 +8,8 @@ void* malloc(size_t size);
 void* calloc(size_t nmemb, size_t size);
 void* realloc(void* ptr, size_t size);
 void free(void* ptr);
+void* memalign(size_t alignment, size_t size);
+int posix_memalign(void** memptr, size_t alignment, size_t size);
 
 // String conversion
 int atoi(const char* nptr);
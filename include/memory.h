@@ -8,10 +8,23 @@
 #define KERNEL_VIRTUAL_BASE     0xC0000000  // 3GB - kernel virtual address
 #define KERNEL_PHYSICAL_BASE    0x00100000  // 1MB - where kernel is loaded
 #define USER_VIRTUAL_BASE       0x40000000  // 1GB - user space starts here
+#define KERNEL_HEAP_START       0xD0000000  // Reserved kernel heap range
+#define KERNEL_HEAP_END         0xE0000000  // 256MB of heap address space
+#define KERNEL_HEAP_INITIAL     0x100000    // 1MB mapped at boot
+#define KERNEL_SCRATCH_START    0xE0000000  // Temporary kernel mappings
 #define PAGE_SIZE               4096        // 4KB pages
+#define LARGE_PAGE_SIZE         0x400000    // 4MB PSE pages
 #define PAGE_DIRECTORY_SIZE     1024
 #define PAGE_TABLE_SIZE         1024
 
+// Permanent linear map of physical memory: every frame the PMM manages
+// lies below PHYS_MAP_LIMIT and is reachable at PHYS_MAP_BASE + phys in
+// every address space, so any page table can be edited without remapping
+#define PHYS_MAP_BASE           0x00000000  // Shares the low identity map
+#define PHYS_MAP_LIMIT          USER_VIRTUAL_BASE
+#define PHYS_TO_VIRT(addr)      ((void*)(PHYS_MAP_BASE + (uint32_t)(addr)))
+#define VIRT_TO_PHYS(ptr)       ((uint32_t)(ptr) - PHYS_MAP_BASE)
+
 // Page flags
 #define PAGE_PRESENT            0x001
 #define PAGE_WRITABLE           0x002
@@ -20,8 +33,16 @@
 #define PAGE_CACHE_DISABLED     0x010
 #define PAGE_ACCESSED           0x020
 #define PAGE_DIRTY              0x040
-#define PAGE_SIZE_FLAG          0x080
+#define PAGE_SIZE_FLAG          0x080       // 4MB page (PDE); vmm_map_range: use 4MB pages where aligned
 #define PAGE_GLOBAL             0x100
+#define PAGE_COW                0x200       // Available bit: shared until written
+
+// Range operations invalidate up to this many pages with invlpg before
+// falling back to one full TLB flush
+#define VMM_INVLPG_MAX          32
+
+// Frames handed back to the PMM per call during address-space teardown
+#define VMM_RELEASE_BATCH       64
 
 // Memory regions
 #define MEMORY_REGION_AVAILABLE 1
@@ -29,13 +50,57 @@
 #define MEMORY_REGION_RECLAIMABLE 3
 #define MEMORY_REGION_NVS       4
 
-// Physical memory manager
+// BIOS E820 memory map, stored by the bootloader before protected mode
+#define E820_MAP_ADDRESS        0x5000
+#define E820_MAX_ENTRIES        32
+
+typedef struct e820_entry {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;                   // MEMORY_REGION_*
+    uint32_t acpi;                   // ACPI 3.0 extended attributes
+} __attribute__((packed)) e820_entry_t;
+
+typedef struct e820_map {
+    uint32_t count;
+    e820_entry_t entries[E820_MAX_ENTRIES];
+} __attribute__((packed)) e820_map_t;
+
+// Per-frame descriptor ("struct page"), one for every managed frame
+#define PAGE_FLAG_KERNEL        0x0001  // Kernel data (heap, slabs, page tables)
+#define PAGE_FLAG_USER          0x0002  // Mapped into a user address space
+#define PAGE_FLAG_CACHE         0x0004  // Holds cached file data
+#define PAGE_FLAG_PINNED        0x0008  // Never reclaimed or moved
+
+typedef struct page {
+    uint16_t refcount;               // Owners of the frame; 0 = free
+    uint16_t flags;                  // PAGE_FLAG_*
+    uint32_t lru_next;               // LRU links, as frame indices
+    uint32_t lru_prev;
+    uint32_t private;                // Owner data; buddy order while allocated
+} page_t;
+
+// Physical memory manager: a frame bitmap plus a binary buddy allocator
+#define PMM_MAX_ORDER           10  // Largest block: 2^10 frames (4MB)
+#define PMM_ZERO_POOL_SIZE      64  // Pre-zeroed frames kept for page tables and stacks
+#define PMM_ZERO_BATCH          4   // Frames zeroed per idle-loop pass
+
 typedef struct {
-    uint32_t* bitmap;
+    page_t* pages;                   // Descriptor for every frame
+    uint32_t* bitmap;                // 1 bit per frame, set = used
     uint32_t bitmap_size;
     uint32_t total_frames;
     uint32_t free_frames;
-    uint32_t first_free_frame;
+    uint32_t base_pfn;               // Page frame number of the first frame
+    uint32_t memory_end;             // End of managed physical memory
+    uint32_t* free_map[PMM_MAX_ORDER + 1];       // 1 bit per block, set = free
+    uint32_t free_map_words[PMM_MAX_ORDER + 1];
+    uint32_t* summary[PMM_MAX_ORDER + 1];        // 1 bit per free_map word, set = non-zero
+    uint32_t summary_words[PMM_MAX_ORDER + 1];
+    uint32_t free_blocks[PMM_MAX_ORDER + 1];     // Free blocks at each order
+    uint32_t free_orders;            // Bit n set when order n has a free block
+    uint32_t zero_pool_hits;         // Zeroed allocations served from the pool
+    uint32_t zero_pool_misses;       // ...and zeroed synchronously
 } physical_memory_manager_t;
 
 // Virtual memory structures
@@ -73,51 +138,178 @@ typedef struct page_table {
     page_table_entry_t entries[PAGE_TABLE_SIZE];
 } __attribute__((aligned(PAGE_SIZE))) page_table_t;
 
-// Enhanced heap allocator
+// Enhanced heap allocator (boundary-tagged blocks)
+// Every block is laid out as [header][payload][footer]
 typedef struct heap_block {
+    size_t size;                     // Payload size in bytes
+    uint32_t magic;                  // Allocated/free marker
+} heap_block_t;
+
+// Footer mirrors the header so a block's physical predecessor is found in O(1)
+typedef struct heap_footer {
     size_t size;
-    int free;
     uint32_t magic;
+} heap_footer_t;
+
+// Free-list links, stored in the payload of free blocks only
+typedef struct heap_free_links {
     struct heap_block* next;
     struct heap_block* prev;
-} heap_block_t;
+} heap_free_links_t;
+
+// Heap accounting tags, one per allocating subsystem
+#define HEAP_TAG_KERNEL         0
+#define HEAP_TAG_LIBC           1
+#define HEAP_TAG_FS             2
+#define HEAP_TAG_GUI            3
+#define HEAP_TAG_SYSCALL        4
+#define HEAP_TAG_CACHED         5   // Idle in a magazine, owned by no one
+#define HEAP_TAG_COUNT          6
+#define HEAP_TAG_MASK           0xFF
 
 typedef struct heap_manager {
-    heap_block_t* first_block;
+    heap_block_t* free_list;
     void* heap_start;
-    void* heap_end;
+    void* heap_end;                  // End of mapped heap pages
+    void* heap_limit;                // End of reserved virtual range
+    size_t min_size;                 // Heap never shrinks below this
     size_t total_size;
     size_t free_size;
     uint32_t blocks_allocated;
     uint32_t blocks_free;
+    size_t tag_bytes[HEAP_TAG_COUNT];    // Live payload bytes per tag
+    uint32_t tag_blocks[HEAP_TAG_COUNT]; // Live blocks per tag
 } heap_manager_t;
 
+// Magazine layer: per-CPU caches of small blocks in front of the heap
+#define HEAP_MAX_CPUS           1
+#define HEAP_MAG_CLASSES        4   // 32, 64, 128 and 256 byte blocks
+#define HEAP_MAG_ROUNDS         14  // Blocks per magazine
+#define HEAP_DEPOT_MAX_FULL     4   // Full magazines kept per class
+
+// A magazine is a small stack of cached blocks ("rounds")
+typedef struct heap_magazine {
+    struct heap_magazine* next;      // Depot list link
+    uint32_t rounds;
+    void* round[HEAP_MAG_ROUNDS];
+} heap_magazine_t;
+
+// Per-CPU state for one size class: a loaded and a previous magazine
+typedef struct heap_cpu_cache {
+    heap_magazine_t* loaded;
+    heap_magazine_t* previous;
+    uint32_t hits;                   // Allocations served without the depot
+} heap_cpu_cache_t;
+
+// Global depot of full and empty magazines for one size class
+typedef struct heap_depot {
+    heap_magazine_t* full;
+    heap_magazine_t* empty;
+    uint32_t full_count;
+    uint32_t empty_count;
+    uint32_t exchanges;              // Magazines swapped with a CPU
+    uint32_t refills;                // Batch refills from the heap
+    uint32_t flushes;                // Magazines returned to the heap
+} heap_depot_t;
+
+// Slab object caches for fixed-size kernel objects
+#define KMEM_CACHE_NAME_LEN        24
+#define KMEM_SLAB_BITMAP_WORDS     16
+#define KMEM_MAX_OBJECTS_PER_SLAB  (KMEM_SLAB_BITMAP_WORDS * 32)
+
+typedef void (*kmem_ctor_t)(void* obj);
+
+// Slab header, stored at the start of its page; objects follow it
+typedef struct kmem_slab {
+    uint32_t magic;
+    struct kmem_cache* cache;        // Owning cache
+    struct kmem_slab* next;
+    struct kmem_slab* prev;
+    uint32_t free_count;             // Free objects in this slab
+    uint32_t bitmap[KMEM_SLAB_BITMAP_WORDS]; // 1 bit per object, set = free
+} kmem_slab_t;
+
+typedef struct kmem_cache {
+    char name[KMEM_CACHE_NAME_LEN];
+    size_t object_size;
+    uint32_t objects_per_slab;
+    uint32_t first_object;           // Offset of first object in a slab
+    kmem_ctor_t ctor;                // Run once per object when a slab is created
+    kmem_slab_t* partial;            // Slabs with at least one free object
+    kmem_slab_t* full;               // Slabs with no free objects
+    uint32_t slab_count;
+    uint32_t active_objects;
+    uint32_t total_allocs;
+    uint32_t total_frees;
+    struct kmem_cache* next;         // Global cache list
+} kmem_cache_t;
+
 // Function prototypes
 // Physical memory management
-void pmm_init(void);
+void pmm_init(const e820_map_t* map);
 uint32_t pmm_alloc_frame(void);
 void pmm_free_frame(uint32_t frame);
+uint32_t pmm_alloc_frames(uint32_t order);
+void pmm_free_frames(uint32_t frame, uint32_t order);
+void pmm_print_stats(void);
+void pmm_benchmark(void);
+uint32_t pmm_alloc_zeroed_frame(void);
+uint32_t pmm_zero_pool_refill(uint32_t max_frames);
+page_t* pmm_get_page(uint32_t frame);
+void pmm_frame_get(uint32_t frame);
+void pmm_frame_put(uint32_t frame);
+void pmm_frame_put_batch(uint32_t* frames, uint32_t count);
 uint32_t pmm_get_free_frames(void);
+uint32_t pmm_get_available_frames(void);
+uint32_t pmm_get_memory_end(void);
 void pmm_mark_frame_used(uint32_t frame);
 
 // Virtual memory management
 void vmm_init(void);
 page_directory_t* vmm_create_page_directory(void);
 void vmm_switch_page_directory(page_directory_t* dir);
-void vmm_map_page(page_directory_t* dir, uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags);
+page_directory_t* vmm_get_current_directory(void);
+page_directory_t* vmm_get_kernel_directory(void);
+int vmm_map_page(page_directory_t* dir, uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags);
+int vmm_reserve_tables(page_directory_t* dir, uint32_t start, uint32_t end);
 void vmm_unmap_page(page_directory_t* dir, uint32_t virtual_addr);
+int vmm_map_range(page_directory_t* dir, uint32_t virtual_addr, uint32_t physical_addr, uint32_t size, uint32_t flags);
+void vmm_unmap_range(page_directory_t* dir, uint32_t virtual_addr, uint32_t size);
+void vmm_benchmark(void);
+void vmm_switch_benchmark(void);
+page_directory_t* vmm_clone_directory(page_directory_t* src);
+void vmm_destroy_directory(page_directory_t* dir);
+int vmm_resolve_cow(page_directory_t* dir, uint32_t virtual_addr);
 uint32_t vmm_get_physical_address(page_directory_t* dir, uint32_t virtual_addr);
 void vmm_enable_paging(void);
 
 // Enhanced heap management
 void heap_init(void* start, size_t size);
 void* heap_malloc(size_t size);
+void* heap_malloc_tagged(size_t size, uint32_t tag);
+void* heap_memalign(size_t alignment, size_t size);
+void* heap_memalign_tagged(size_t alignment, size_t size, uint32_t tag);
 void* heap_calloc(size_t nmemb, size_t size);
 void* heap_realloc(void* ptr, size_t size);
 void heap_free(void* ptr);
+
+// Same, with the profiler call site supplied by a wrapper (e.g. libc)
+void* heap_malloc_tagged_at(size_t size, uint32_t tag, void* site);
+void* heap_memalign_tagged_at(size_t alignment, size_t size, uint32_t tag, void* site);
+void* heap_realloc_at(void* ptr, size_t size, void* site);
+void heap_free_at(void* ptr, void* site);
+void heap_magazine_init(void);
 void heap_print_stats(void);
+void heap_profile_report(void);
 int heap_validate(void);
 
+// Slab allocator
+void kmem_init(void);
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, kmem_ctor_t ctor);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+void kmem_print_stats(void);
+
 // Memory utilities
 void memory_copy_page(uint32_t dest, uint32_t src);
 void memory_zero_page(uint32_t addr);
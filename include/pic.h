@@ -13,11 +13,13 @@
 // PIC initialization commands
 #define ICW1_INIT    0x11    // Initialize the PIC and enable ICW4
 #define ICW4_8086    0x01    // 8086/88 mode
+#define OCW3_READ_IRR 0x0A   // Next command port read returns the IRR
 
 // Function prototypes
 void pic_init();
 void pic_send_eoi(uint8_t irq);
 void irq_set_mask(uint8_t irq);
 void irq_clear_mask(uint8_t irq);
+int irq_pending(uint8_t irq);
 
 #endif 
\ No newline at end of file
@@ -15,11 +15,48 @@
 #define PROCESS_PRIORITY_NORMAL 2
 #define PROCESS_PRIORITY_LOW    3
 
+// One run queue per priority; level 0 is PROCESS_PRIORITY_HIGH
+#define SCHED_LEVELS            3
+#define SCHED_LEVEL(priority)   ((priority) - PROCESS_PRIORITY_HIGH)
+
+// A process waiting this many ticks at the head of its queue moves up a level
+#define SCHED_AGING_TICKS       250
+
 // Maximum number of processes
 #define MAX_PROCESSES 32
 
-// Process stack size (4KB)
-#define PROCESS_STACK_SIZE 4096
+// Process stack size (64KB, faulted in a page at a time)
+#define PROCESS_STACK_SIZE 0x10000
+
+// User address space layout
+#define PROCESS_STACK_BASE  (USER_VIRTUAL_BASE + 0x10000)
+#define PROCESS_HEAP_BASE   (USER_VIRTUAL_BASE + 0x20000)
+#define PROCESS_HEAP_SIZE   0xE0000     // Heap ends at 1MB into user space
+#define PROCESS_MMAP_BASE   (USER_VIRTUAL_BASE + 0x100000)
+
+// Kernel stacks are 2^order contiguous frames from the buddy allocator (8KB)
+#define PROCESS_KERNEL_STACK_ORDER 1
+
+// Virtual memory area kinds
+#define VMA_STACK   1
+#define VMA_HEAP    2
+#define VMA_ANON    3   // Anonymous mmap
+
+// Maximum regions per address space
+#define PROCESS_MAX_VMAS 8
+
+// Page-fault error code bits
+#define PF_PRESENT  0x1     // Protection violation (clear: page not present)
+#define PF_WRITE    0x2     // Faulting access was a write
+#define PF_USER     0x4     // Fault happened in user mode
+
+// A region of user address space backed by zeroed frames on first touch
+typedef struct vm_area {
+    uint32_t start;                  // First byte (page aligned)
+    uint32_t end;                    // One past the last byte (page aligned)
+    uint32_t flags;                  // PAGE_* bits for pages faulted in
+    uint32_t type;                   // VMA_*
+} vm_area_t;
 
 // Process control block (PCB)
 typedef struct process {
@@ -35,24 +72,37 @@ typedef struct process {
     uint32_t esp, ebp;               // Stack and base pointers
     uint32_t eip;                    // Instruction pointer
     uint32_t eflags;                 // Flags register
+    uint32_t kernel_esp;             // Saved kernel stack pointer while switched out
     
     // Memory management
     page_directory_t* page_directory; // Virtual memory space
     uint32_t kernel_stack;           // Kernel stack pointer
-    uint32_t user_stack;             // User stack pointer
     uint32_t heap_start;             // Heap start address
     uint32_t heap_end;               // Heap end address
+    vm_area_t vmas[PROCESS_MAX_VMAS]; // Regions mapped lazily on fault
+    uint32_t vma_count;              // Entries used in vmas
+    uint32_t mmap_next;              // Next free address for anonymous mmap
+    uint32_t page_faults;            // Pages faulted in so far
     
     // Scheduling
     uint32_t time_slice;             // Time slice in milliseconds
     uint32_t time_used;              // Time used in current slice
     uint32_t total_time;             // Total CPU time used
+    uint32_t ready_since;            // Tick it joined (or last rose in) its run queue
+    struct task_queue* run_queue;    // Queue it is on, NULL when not queued
+    uint32_t wake_tick;              // Tick a sleeping process is due to wake
+    struct process** sleep_slot;     // Timer wheel slot it sleeps in, NULL when awake
+    struct process* sleep_next;      // Links within that slot
+    struct process* sleep_prev;
+    struct wait_queue* wait_queue;   // Wait queue it is blocked on, if any
+    uint32_t sched_level;            // Level it was dispatched from (aging may lift it)
     
     // File system
     char current_directory[256];     // Current working directory
     
     // Linked list for scheduler
     struct process* next;
+    struct process* prev;
     
     // Process creation time
     uint32_t creation_time;
@@ -75,6 +125,8 @@ typedef struct scheduler_stats {
     uint32_t context_switches;
     uint32_t time_slices;
     uint32_t idle_time;
+    uint32_t promotions;             // Processes moved up a level by aging
+    uint32_t blocks;                 // Times a process blocked (sleep, wait)
 } scheduler_stats_t;
 
 // Global current process variable
@@ -86,25 +138,44 @@ extern process_t* current_process;
 // Process management
 void process_init(void);
 process_t* process_create(const char* name, void* entry_point, uint32_t priority);
+process_t* process_create_thread(const char* name, void* entry_point, uint32_t priority);
+process_t* process_spawn_cow(process_t* parent);
 void process_destroy(process_t* process);
 process_t* process_get_current(void);
 process_t* process_get_by_pid(uint32_t pid);
 void process_exit(int exit_code);
+void process_stress_test(uint32_t rounds);
 uint32_t process_get_next_pid(void);
 
+// Virtual memory areas and demand paging
+void vma_init(void);
+vm_area_t* vma_find(process_t* process, uint32_t addr);
+int vma_add(process_t* process, uint32_t start, uint32_t end, uint32_t flags, uint32_t type);
+uint32_t vma_mmap(process_t* process, uint32_t length);
+int vma_munmap(process_t* process, uint32_t addr, uint32_t length);
+
 // Scheduler
 void scheduler_init(void);
 void scheduler_add_process(process_t* process);
 void scheduler_remove_process(process_t* process);
 void scheduler_tick(void);
 void scheduler_yield(void);
+int scheduler_can_block(void);
+void scheduler_block(void);
+void scheduler_wake(process_t* process);
+void scheduler_account_ticks(uint32_t ticks);
+uint32_t scheduler_ready_count(void);
 void scheduler_schedule(void);
 void scheduler_print_stats(void);
 
 // Context switching
 void context_switch(process_t* from, process_t* to);
-void save_context(process_t* process);
-void load_context(process_t* process);
+void scheduler_finish_switch(void);
+void scheduler_benchmark(void);
+void scheduler_sleep_benchmark(void);
+
+// Save callee-saved registers and ESP to *save_esp, load load_esp (switch.asm)
+void context_switch_asm(uint32_t* save_esp, uint32_t load_esp);
 
 // System calls are now handled in syscall.h
 
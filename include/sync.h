@@ -0,0 +1,59 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include "libc/stdint.h"
+#include "process.h"
+
+// FIFO of processes blocked on some condition
+typedef struct wait_queue {
+    process_t* head;
+    process_t* tail;
+} wait_queue_t;
+
+// Sleeping lock; only the owner may unlock it
+typedef struct mutex {
+    process_t* owner;
+    wait_queue_t waiters;
+} mutex_t;
+
+// Counting semaphore
+typedef struct semaphore {
+    int32_t count;
+    wait_queue_t waiters;
+} semaphore_t;
+
+// Condition variable, always used with a mutex
+typedef struct condition {
+    wait_queue_t waiters;
+} condition_t;
+
+// Wait queues. wait_queue_sleep must be called with interrupts off and
+// may return early, so callers re-check their condition in a loop
+void wait_queue_init(wait_queue_t* queue);
+void wait_queue_sleep(wait_queue_t* queue);
+int wait_queue_wake_one(wait_queue_t* queue);
+uint32_t wait_queue_wake_all(wait_queue_t* queue);
+void wait_queue_cancel(process_t* process);
+
+// Mutexes
+void mutex_init(mutex_t* mutex);
+void mutex_lock(mutex_t* mutex);
+int mutex_trylock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+// Semaphores
+void semaphore_init(semaphore_t* sem, int32_t count);
+void semaphore_wait(semaphore_t* sem);
+int semaphore_trywait(semaphore_t* sem);
+void semaphore_signal(semaphore_t* sem);
+
+// Condition variables
+void condition_init(condition_t* cond);
+void condition_wait(condition_t* cond, mutex_t* mutex);
+void condition_signal(condition_t* cond);
+void condition_broadcast(condition_t* cond);
+
+// Producer/consumer run over all three primitives
+void sync_self_test(void);
+
+#endif /* SYNC_H */
@@ -14,7 +14,7 @@
 #define SYS_FREE        6   // Free memory
 #define SYS_GETPID      7   // Get process ID
 #define SYS_SLEEP       8   // Sleep for specified time
-#define SYS_FORK        9   // Create new process
+#define SYS_FORK        9   // Reserved; fork is not implemented
 #define SYS_EXEC        10  // Execute program
 #define SYS_WAIT        11  // Wait for child process
 #define SYS_KILL        12  // Send signal to process
@@ -35,7 +35,8 @@
 #define SYS_SEEK        27  // Seek in file
 #define SYS_DUP         28  // Duplicate file descriptor
 #define SYS_PIPE        29  // Create pipe
-#define SYS_MAX         30  // Maximum system call number
+#define SYS_SPAWN_COW   30  // Start a process at the caller's entry point on a COW copy
+#define SYS_MAX         31  // Maximum system call number
 
 // File descriptor constants
 #define STDIN_FILENO    0
@@ -92,6 +93,9 @@ void* sys_malloc(uint32_t size);
 int32_t sys_free(void* ptr);
 int32_t sys_getpid(void);
 int32_t sys_sleep(uint32_t seconds);
+int32_t sys_spawn_cow(void);
+void* sys_mmap(uint32_t length);
+int32_t sys_munmap(void* addr, uint32_t length);
 
 // Internal kernel implementations
 int32_t kernel_exit(int32_t status);
@@ -110,6 +114,9 @@ int32_t kernel_rmdir(const char* pathname);
 int32_t kernel_unlink(const char* pathname);
 int32_t kernel_stat(const char* pathname, void* statbuf);
 uint32_t kernel_time(void);
+int32_t kernel_spawn_cow(void);
+void* kernel_mmap(uint32_t length);
+int32_t kernel_munmap(void* addr, uint32_t length);
 
 // Additional utility functions
 uint32_t get_errno(void);
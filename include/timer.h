@@ -19,6 +19,24 @@
 #define PIT_CHANNEL_0           0x00
 #define PIT_ACCESS_LOHIBYTE     0x30
 #define PIT_MODE_SQUARE_WAVE    0x06
+#define PIT_MODE_ONESHOT        0x00    // Mode 0: interrupt on terminal count
+#define PIT_MODE_RATE_GENERATOR 0x04    // Mode 2: periodic, counts down by one
+#define PIT_LATCH_COUNT         0x00    // Channel 0 counter latch command
+
+// PIT input clock and the counts in one tick
+#define PIT_BASE_FREQUENCY      1193180
+#define PIT_TICK_COUNT          (PIT_BASE_FREQUENCY / TIMER_FREQUENCY)
+
+// Longest one-shot the 16-bit counter can hold, in ticks (about 54ms)
+#define TIMER_TICKLESS_MAX_TICKS (0xFFFF / PIT_TICK_COUNT)
+
+// Sleep timer wheel: 256 one-tick slots, then 64 slots of 256 ticks each
+// (about 16 seconds); longer sleeps wait in the last outer slot
+#define TIMER_WHEEL_BITS        8
+#define TIMER_WHEEL_SIZE        (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_OUTER_SIZE  64
+
+struct process;
 
 // Time structure
 typedef struct {
@@ -34,6 +52,11 @@ typedef struct {
     uint32_t interrupts_per_second;
     uint32_t missed_ticks;
     uint32_t scheduler_calls;
+    uint32_t wakeups;               // Sleeping processes woken by the wheel
+    uint32_t cascades;              // Sleepers moved from the outer to the inner wheel
+    uint32_t interrupts;            // Timer interrupts actually taken
+    uint32_t tickless_entries;      // Times the periodic tick was stopped for idle
+    uint32_t skipped_ticks;         // Ticks accounted without an interrupt
 } timer_stats_t;
 
 // Global timer variables
@@ -46,6 +69,8 @@ void timer_handler(registers_t regs);
 void timer_set_frequency(uint32_t frequency);
 uint32_t timer_get_ticks(void);
 void timer_sleep(uint32_t milliseconds);
+void timer_cancel_sleep(struct process* process);
+void timer_idle(void);
 void timer_update_system_time(void);
 void timer_get_system_time(system_time_t* time);
 void timer_print_stats(void);
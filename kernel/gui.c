@@ -3,7 +3,6 @@
 #include "../include/keyboard.h"
 #include "../include/memory.h"
 #include "../include/libc/string.h"
-#include "../include/libc/stdlib.h"
 #include "../include/serial.h"
 #include "../include/utils.h"
 
@@ -49,6 +48,14 @@ typedef struct gui_state {
 
 static gui_state_t gui_state;
 
+// Slab cache for window descriptors
+static kmem_cache_t* window_cache = NULL;
+
+// Slab constructor: windows start out zeroed with no content buffer
+static void window_ctor(void* obj) {
+    memset(obj, 0, sizeof(window_t));
+}
+
 // Function prototypes
 void gui_init(void);
 void gui_main_loop(void);
@@ -112,6 +119,10 @@ void gui_init(void) {
     gui_state.mouse_pos.y = VGA_HEIGHT / 2;
     gui_state.desktop_initialized = 1;
     
+    if (!window_cache) {
+        window_cache = kmem_cache_create("window_t", sizeof(window_t), window_ctor);
+    }
+    
     serial_write_string("GUI: GUI subsystem initialized\n");
 }
 
@@ -211,9 +222,13 @@ window_t* gui_create_window(const char* title, int x, int y, int width, int heig
         serial_write_string("GUI: Maximum windows reached\n");
         return NULL;
     }
+    if (width <= 0 || height <= 0) {
+        serial_write_string("GUI: Invalid window size\n");
+        return NULL;
+    }
     
     // Allocate window structure
-    window_t* window = (window_t*)malloc(sizeof(window_t));
+    window_t* window = (window_t*)kmem_cache_alloc(window_cache);
     if (!window) {
         serial_write_string("GUI: Failed to allocate window memory\n");
         return NULL;
@@ -233,6 +248,15 @@ window_t* gui_create_window(const char* title, int x, int y, int width, int heig
     window->owner_process = process_get_current();
     window->next = NULL;
     
+    // Backing store, one byte per pixel; charged to the GUI accounting tag
+    window->content_buffer = (uint8_t*)heap_malloc_tagged(width * height, HEAP_TAG_GUI);
+    if (!window->content_buffer) {
+        serial_write_string("GUI: Failed to allocate window content\n");
+        kmem_cache_free(window_cache, window);
+        return NULL;
+    }
+    memset(window->content_buffer, 0, width * height);
+    
     // Add to window list
     gui_state.windows[gui_state.window_count] = window;
     gui_state.window_count++;
@@ -274,9 +298,10 @@ void gui_destroy_window(window_t* window) {
     
     // Free window memory
     if (window->content_buffer) {
-        free(window->content_buffer);
+        heap_free(window->content_buffer);
+        window->content_buffer = NULL;
     }
-    free(window);
+    kmem_cache_free(window_cache, window);
     
     serial_write_string("GUI: Window destroyed\n");
 }
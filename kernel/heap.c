@@ -2,59 +2,306 @@
 #include "../include/libc/string.h"
 #include "../include/serial.h"
 #include "../include/utils.h"
+#include "../include/cpu.h"
+#ifdef HEAP_PROFILE
+#include "../include/timer.h"
+#endif
 
 // Heap magic numbers for corruption detection
-#define HEAP_MAGIC_ALLOCATED 0xABCDEF00
+#define HEAP_MAGIC_ALLOCATED 0xABCDEF00  // Low byte holds the accounting tag
 #define HEAP_MAGIC_FREE      0x12345678
 #define HEAP_MAGIC_FOOTER    0x87654321
 
 // Minimum allocation size (must be multiple of 8 for alignment)
 #define MIN_ALLOC_SIZE 32
 
+// Heap growth granularity and free slack kept mapped at the end
+#define HEAP_GROW_MIN   0x10000  // 64KB
+#define HEAP_TRIM_SLACK 0x10000  // 64KB
+
+// Per-block bookkeeping overhead
+#define HEAP_HEADER_SIZE   sizeof(heap_block_t)
+#define HEAP_FOOTER_SIZE   sizeof(heap_footer_t)
+#define HEAP_OVERHEAD      (HEAP_HEADER_SIZE + HEAP_FOOTER_SIZE)
+
+// Block accessors
+#define BLOCK_PAYLOAD(b)   ((void*)((char*)(b) + HEAP_HEADER_SIZE))
+#define BLOCK_FOOTER(b)    ((heap_footer_t*)((char*)(b) + HEAP_HEADER_SIZE + (b)->size))
+#define BLOCK_LINKS(b)     ((heap_free_links_t*)BLOCK_PAYLOAD(b))
+#define BLOCK_IS_FREE(b)   ((b)->magic == HEAP_MAGIC_FREE)
+#define BLOCK_IS_USED(b)   (((b)->magic & ~HEAP_TAG_MASK) == HEAP_MAGIC_ALLOCATED)
+#define BLOCK_TAG(b)       ((b)->magic & HEAP_TAG_MASK)
+#define BLOCK_FROM_PTR(p)  ((heap_block_t*)((char*)(p) - HEAP_HEADER_SIZE))
+
+// Magazine size classes run from MIN_ALLOC_SIZE up in powers of two
+#define HEAP_MAG_MAX_SIZE  (MIN_ALLOC_SIZE << (HEAP_MAG_CLASSES - 1))
+#define HEAP_MAG_BATCH     (HEAP_MAG_ROUNDS / 2)  // Blocks per refill from the heap
+
+// Live-object histogram buckets: 32 bytes doubling up to 64KB and beyond
+#define HEAP_HIST_BUCKETS  12
+
 static heap_manager_t heap_manager;
 static int heap_initialized = 0;
 
-// Initialize the heap
+// Magazine layer state; the depot and heap_manager are the only shared parts
+static heap_cpu_cache_t heap_cpu_caches[HEAP_MAX_CPUS][HEAP_MAG_CLASSES];
+static heap_depot_t heap_depot[HEAP_MAG_CLASSES];
+static kmem_cache_t* magazine_cache = NULL;
+static int magazines_enabled = 0;
+
+#ifdef HEAP_PROFILE
+// Profiler ring buffer of recent heap events (make HEAP_PROFILE=1)
+#define HEAP_PROF_EVENTS   512
+#define HEAP_PROF_SITES    64
+#define HEAP_PROF_TOP      8
+
+#define HEAP_PROF_ALLOC    0
+#define HEAP_PROF_FREE     1
+#define HEAP_PROF_REALLOC  2
+
+typedef struct heap_prof_event {
+    void* site;                      // Caller's return address
+    void* ptr;
+    uint32_t size;
+    uint32_t tick;                   // timer_ticks at the time of the call
+    uint8_t op;
+    uint8_t size_class;              // log2 bucket of the size
+    uint8_t tag;
+} heap_prof_event_t;
+
+static heap_prof_event_t heap_prof_ring[HEAP_PROF_EVENTS];
+static uint32_t heap_prof_head = 0;  // Total events ever recorded
+
+static uint8_t heap_size_bucket(size_t size);
+
+static void heap_profile_record(uint8_t op, void* ptr, size_t size, void* site) {
+    if (!ptr) {
+        return;
+    }
+    
+    heap_prof_event_t* event = &heap_prof_ring[heap_prof_head % HEAP_PROF_EVENTS];
+    event->site = site;
+    event->ptr = ptr;
+    event->size = size;
+    event->tick = timer_ticks;
+    event->op = op;
+    event->size_class = heap_size_bucket(size);
+    event->tag = BLOCK_TAG(BLOCK_FROM_PTR(ptr));
+    heap_prof_head++;
+}
+
+// The site is taken once at the public entry point and passed down
+#define HEAP_PROFILE_RECORD(op, ptr, size, site) \
+    heap_profile_record((op), (ptr), (size), (site))
+#else
+#define HEAP_PROFILE_RECORD(op, ptr, size, site) ((void)(site))
+#endif
+
+// Write matching header and footer tags for a block
+static void set_block(heap_block_t* block, size_t size, uint32_t magic) {
+    block->size = size;
+    block->magic = magic;
+    
+    heap_footer_t* footer = BLOCK_FOOTER(block);
+    footer->size = size;
+    footer->magic = HEAP_MAGIC_FOOTER;
+}
+
+// Physically adjacent block after this one (NULL at end of heap)
+static heap_block_t* next_block(heap_block_t* block) {
+    char* next = (char*)block + HEAP_OVERHEAD + block->size;
+    if (next >= (char*)heap_manager.heap_end) {
+        return NULL;
+    }
+    return (heap_block_t*)next;
+}
+
+// Physically adjacent block before this one, found through its footer
+static heap_block_t* prev_block(heap_block_t* block) {
+    if ((char*)block <= (char*)heap_manager.heap_start) {
+        return NULL;
+    }
+    
+    heap_footer_t* footer = (heap_footer_t*)((char*)block - HEAP_FOOTER_SIZE);
+    if (footer->magic != HEAP_MAGIC_FOOTER) {
+        serial_write_string("HEAP ERROR: Corrupted footer before block\n");
+        return NULL;
+    }
+    
+    return (heap_block_t*)((char*)block - HEAP_OVERHEAD - footer->size);
+}
+
+// Push a block onto the free list
+static void free_list_insert(heap_block_t* block) {
+    heap_free_links_t* links = BLOCK_LINKS(block);
+    links->prev = NULL;
+    links->next = heap_manager.free_list;
+    
+    if (heap_manager.free_list) {
+        BLOCK_LINKS(heap_manager.free_list)->prev = block;
+    }
+    
+    heap_manager.free_list = block;
+}
+
+// Unlink a block from the free list
+static void free_list_remove(heap_block_t* block) {
+    heap_free_links_t* links = BLOCK_LINKS(block);
+    
+    if (links->prev) {
+        BLOCK_LINKS(links->prev)->next = links->next;
+    } else {
+        heap_manager.free_list = links->next;
+    }
+    
+    if (links->next) {
+        BLOCK_LINKS(links->next)->prev = links->prev;
+    }
+}
+
+// Last block in the heap, found through the footer at heap_end
+static heap_block_t* last_block(void) {
+    if (heap_manager.heap_end == heap_manager.heap_start) {
+        return NULL;
+    }
+    
+    heap_footer_t* footer = (heap_footer_t*)((char*)heap_manager.heap_end - HEAP_FOOTER_SIZE);
+    return (heap_block_t*)((char*)footer - footer->size - HEAP_HEADER_SIZE);
+}
+
+// Map fresh frames at the end of the heap; returns number of bytes added
+static size_t heap_grow(size_t min_bytes) {
+    size_t grow_size = memory_align_up(min_bytes, PAGE_SIZE);
+    if (grow_size < HEAP_GROW_MIN) {
+        grow_size = HEAP_GROW_MIN;
+    }
+    
+    uint32_t old_end = (uint32_t)heap_manager.heap_end;
+    if (old_end + grow_size > (uint32_t)heap_manager.heap_limit ||
+        old_end + grow_size < old_end) {
+        grow_size = (uint32_t)heap_manager.heap_limit - old_end;
+        if (grow_size < min_bytes) {
+            return 0; // Reserved virtual range exhausted
+        }
+    }
+    
+    // Back each new page with a physical frame
+    page_directory_t* dir = vmm_get_kernel_directory();
+    for (uint32_t offset = 0; offset < grow_size; offset += PAGE_SIZE) {
+        uint32_t frame = pmm_alloc_frame();
+        if (!frame) {
+            // Roll back the pages mapped so far
+            vmm_unmap_range(dir, old_end, offset);
+            return 0;
+        }
+        pmm_get_page(frame)->flags = PAGE_FLAG_KERNEL;
+        if (vmm_map_page(dir, old_end + offset, frame, PAGE_PRESENT | PAGE_WRITABLE | PAGE_GLOBAL) != 0) {
+            pmm_free_frame(frame);
+            vmm_unmap_range(dir, old_end, offset);
+            return 0;
+        }
+    }
+    
+    // Extend a trailing free block or start a new one
+    heap_block_t* tail = last_block();
+    heap_manager.heap_end = (void*)(old_end + grow_size);
+    heap_manager.total_size += grow_size;
+    heap_manager.free_size += grow_size;
+    
+    if (tail && BLOCK_IS_FREE(tail)) {
+        set_block(tail, tail->size + grow_size, HEAP_MAGIC_FREE);
+    } else {
+        heap_block_t* block = (heap_block_t*)old_end;
+        set_block(block, grow_size - HEAP_OVERHEAD, HEAP_MAGIC_FREE);
+        free_list_insert(block);
+        heap_manager.blocks_free++;
+    }
+    
+    return grow_size;
+}
+
+// Return whole free pages at the end of the heap to the PMM
+static void heap_trim(void) {
+    heap_block_t* tail = last_block();
+    if (!tail || !BLOCK_IS_FREE(tail)) {
+        return;
+    }
+    
+    // Keep the block's header, minimum payload and some slack mapped
+    uint32_t keep_end = memory_align_up((uint32_t)BLOCK_PAYLOAD(tail) + MIN_ALLOC_SIZE +
+                                        HEAP_FOOTER_SIZE + HEAP_TRIM_SLACK, PAGE_SIZE);
+    uint32_t old_end = (uint32_t)heap_manager.heap_end;
+    if (keep_end >= old_end) {
+        return;
+    }
+    
+    // Never shrink below the initial heap size
+    if (keep_end < (uint32_t)heap_manager.heap_start + heap_manager.min_size) {
+        keep_end = (uint32_t)heap_manager.heap_start + heap_manager.min_size;
+        if (keep_end >= old_end) {
+            return;
+        }
+    }
+    
+    size_t released = old_end - keep_end;
+    set_block(tail, tail->size - released, HEAP_MAGIC_FREE);
+    
+    page_directory_t* dir = vmm_get_kernel_directory();
+    vmm_unmap_range(dir, keep_end, released); // Frees the backing frames
+    
+    heap_manager.heap_end = (void*)keep_end;
+    heap_manager.total_size -= released;
+    heap_manager.free_size -= released;
+}
+
+// Initialize the heap over a reserved kernel virtual range
 void heap_init(void* start, size_t size) {
     serial_write_string("Initializing enhanced heap manager...\n");
     
-    // Ensure start address is page-aligned
-    uint32_t heap_start = memory_align_up((uint32_t)start, 16);
-    size_t aligned_size = size - (heap_start - (uint32_t)start);
+    uint32_t heap_start = memory_align_up((uint32_t)start, PAGE_SIZE);
     
     heap_manager.heap_start = (void*)heap_start;
-    heap_manager.heap_end = (void*)(heap_start + aligned_size);
-    heap_manager.total_size = aligned_size;
-    heap_manager.free_size = aligned_size - sizeof(heap_block_t);
+    heap_manager.heap_end = (void*)heap_start;
+    heap_manager.heap_limit = (void*)KERNEL_HEAP_END;
+    heap_manager.min_size = memory_align_up(size, PAGE_SIZE);
+    heap_manager.total_size = 0;
+    heap_manager.free_size = 0;
     heap_manager.blocks_allocated = 0;
-    heap_manager.blocks_free = 1;
+    heap_manager.blocks_free = 0;
+    heap_manager.free_list = NULL;
+    memset(heap_manager.tag_bytes, 0, sizeof(heap_manager.tag_bytes));
+    memset(heap_manager.tag_blocks, 0, sizeof(heap_manager.tag_blocks));
+    
+    // Every page table for the heap range exists before any process
+    // directory copies the kernel entries, so growth is visible everywhere
+    if (vmm_reserve_tables(vmm_get_kernel_directory(), heap_start, KERNEL_HEAP_END) != 0) {
+        serial_write_string("HEAP ERROR: Could not allocate heap page tables\n");
+        return;
+    }
     
-    // Create the first free block
-    heap_block_t* first_block = (heap_block_t*)heap_start;
-    first_block->size = aligned_size - sizeof(heap_block_t);
-    first_block->free = 1;
-    first_block->magic = HEAP_MAGIC_FREE;
-    first_block->next = NULL;
-    first_block->prev = NULL;
+    // Map the initial pages; the first free block spans all of them
+    if (!heap_grow(heap_manager.min_size)) {
+        serial_write_string("HEAP ERROR: Could not map initial heap\n");
+        return;
+    }
     
-    heap_manager.first_block = first_block;
     heap_initialized = 1;
     
     char buffer[32];
     serial_write_string("Heap initialized: ");
-    itoa(aligned_size / 1024, buffer, 10);
+    itoa(heap_manager.total_size / 1024, buffer, 10);
     serial_write_string(buffer);
-    serial_write_string("KB available\n");
+    serial_write_string("KB mapped, grows on demand\n");
 }
 
 // Find best-fit free block
 static heap_block_t* find_best_fit(size_t size) {
-    heap_block_t* current = heap_manager.first_block;
+    heap_block_t* current = heap_manager.free_list;
     heap_block_t* best = NULL;
     size_t best_size = SIZE_MAX;
     
     while (current) {
-        if (current->free && current->size >= size && current->size < best_size) {
+        if (current->size >= size && current->size < best_size) {
             best = current;
             best_size = current->size;
             
@@ -63,70 +310,341 @@ static heap_block_t* find_best_fit(size_t size) {
                 break;
             }
         }
-        current = current->next;
+        current = BLOCK_LINKS(current)->next;
     }
     
     return best;
 }
 
-// Split a block if it's large enough
+// Split a block if it's large enough, returning the tail to the free list
 static void split_block(heap_block_t* block, size_t size) {
-    size_t remaining_size = block->size - size - sizeof(heap_block_t);
+    if (block->size < size + HEAP_OVERHEAD + MIN_ALLOC_SIZE) {
+        return; // Remainder not worth a block of its own
+    }
     
-    // Only split if remaining size is worth it
-    if (remaining_size >= MIN_ALLOC_SIZE) {
-        heap_block_t* new_block = (heap_block_t*)((char*)block + sizeof(heap_block_t) + size);
-        
-        new_block->size = remaining_size;
-        new_block->free = 1;
-        new_block->magic = HEAP_MAGIC_FREE;
-        new_block->next = block->next;
-        new_block->prev = block;
-        
-        if (block->next) {
-            block->next->prev = new_block;
+    size_t remaining_size = block->size - size - HEAP_OVERHEAD;
+    
+    set_block(block, size, block->magic);
+    
+    heap_block_t* new_block = next_block(block);
+    set_block(new_block, remaining_size, HEAP_MAGIC_FREE);
+    free_list_insert(new_block);
+    
+    heap_manager.blocks_free++;
+}
+
+// Merge a free block with its free physical neighbours using the boundary tags
+static heap_block_t* merge_free_blocks(heap_block_t* block) {
+    // Merge with next block if free
+    heap_block_t* next = next_block(block);
+    if (next && BLOCK_IS_FREE(next)) {
+        free_list_remove(next);
+        set_block(block, block->size + HEAP_OVERHEAD + next->size, HEAP_MAGIC_FREE);
+        heap_manager.blocks_free--;
+    }
+    
+    // Merge into previous block if free (it is already on the free list)
+    heap_block_t* prev = prev_block(block);
+    if (prev && BLOCK_IS_FREE(prev)) {
+        set_block(prev, prev->size + HEAP_OVERHEAD + block->size, HEAP_MAGIC_FREE);
+        heap_manager.blocks_free--;
+        return prev;
+    }
+    
+    free_list_insert(block);
+    return block;
+}
+
+// Tag names for per-subsystem accounting
+static const char* heap_tag_names[HEAP_TAG_COUNT] = {
+    "kernel", "libc", "fs", "gui", "syscall", "magazine"
+};
+
+static int heap_depot_reclaim(void);
+
+// Carve a block of an already aligned size out of the free lists
+static void* heap_alloc_block(size_t size, uint32_t tag) {
+    // Find best-fit block, growing the heap if nothing fits
+    heap_block_t* block = find_best_fit(size);
+    if (!block) {
+        if (!heap_grow(size + HEAP_OVERHEAD) && !heap_depot_reclaim()) {
+            return NULL; // Out of memory
+        }
+        block = find_best_fit(size);
+        if (!block) {
+            return NULL;
         }
-        
-        block->next = new_block;
-        block->size = size;
-        
-        heap_manager.blocks_free++;
     }
+    
+    free_list_remove(block);
+    
+    // Split block if necessary
+    split_block(block, size);
+    
+    // Mark block as allocated
+    set_block(block, block->size, HEAP_MAGIC_ALLOCATED | tag);
+    
+    // Update statistics
+    heap_manager.blocks_allocated++;
+    heap_manager.blocks_free--;
+    heap_manager.free_size -= (block->size + HEAP_OVERHEAD);
+    heap_manager.tag_bytes[tag] += block->size;
+    heap_manager.tag_blocks[tag]++;
+    
+    // Return pointer to user data
+    return BLOCK_PAYLOAD(block);
 }
 
-// Merge adjacent free blocks
-static void merge_free_blocks(heap_block_t* block) {
-    // Merge with next block if free
-    if (block->next && block->next->free) {
-        heap_block_t* next = block->next;
-        
-        block->size += sizeof(heap_block_t) + next->size;
-        block->next = next->next;
-        
-        if (next->next) {
-            next->next->prev = block;
+// Return a validated allocated block to the free lists
+static void heap_release_block(heap_block_t* block) {
+    // Update statistics
+    heap_manager.tag_bytes[BLOCK_TAG(block)] -= block->size;
+    heap_manager.tag_blocks[BLOCK_TAG(block)]--;
+    
+    // Mark block as free
+    block->magic = HEAP_MAGIC_FREE;
+    
+    heap_manager.blocks_allocated--;
+    heap_manager.blocks_free++;
+    heap_manager.free_size += (block->size + HEAP_OVERHEAD);
+    
+    // Merge with adjacent free blocks
+    merge_free_blocks(block);
+    
+    // Hand trailing free pages back to the PMM
+    heap_trim();
+}
+
+// Move an allocated block's accounting to another tag
+static void heap_retag(heap_block_t* block, uint32_t tag) {
+    heap_manager.tag_bytes[BLOCK_TAG(block)] -= block->size;
+    heap_manager.tag_blocks[BLOCK_TAG(block)]--;
+    
+    block->magic = HEAP_MAGIC_ALLOCATED | tag;
+    
+    heap_manager.tag_bytes[tag] += block->size;
+    heap_manager.tag_blocks[tag]++;
+}
+
+// Size class for an aligned request, or -1 if it bypasses the magazines
+static int mag_class_of_size(size_t size) {
+    if (size > HEAP_MAG_MAX_SIZE) {
+        return -1;
+    }
+    
+    int class = 0;
+    while ((size_t)(MIN_ALLOC_SIZE << class) < size) {
+        class++;
+    }
+    return class;
+}
+
+// Size class a free block can serve: the largest class that fits in it
+static int mag_class_of_block(size_t size) {
+    if (size < MIN_ALLOC_SIZE || size >= (HEAP_MAG_MAX_SIZE << 1)) {
+        return -1;
+    }
+    
+    int class = HEAP_MAG_CLASSES - 1;
+    while ((size_t)(MIN_ALLOC_SIZE << class) > size) {
+        class--;
+    }
+    return class;
+}
+
+// Only the boot CPU runs today; an SMP kernel would read its APIC ID here
+static inline uint32_t heap_cpu_id(void) {
+    return 0;
+}
+
+// Depot list helpers
+static heap_magazine_t* depot_pop(heap_magazine_t** list) {
+    heap_magazine_t* mag = *list;
+    if (mag) {
+        *list = mag->next;
+        mag->next = NULL;
+    }
+    return mag;
+}
+
+static void depot_push(heap_magazine_t** list, heap_magazine_t* mag) {
+    mag->next = *list;
+    *list = mag;
+}
+
+// Get an empty magazine, from the depot if possible
+static heap_magazine_t* magazine_get_empty(heap_depot_t* depot) {
+    heap_magazine_t* mag = depot_pop(&depot->empty);
+    if (mag) {
+        depot->empty_count--;
+        return mag;
+    }
+    
+    mag = (heap_magazine_t*)kmem_cache_alloc(magazine_cache);
+    if (mag) {
+        mag->next = NULL;
+        mag->rounds = 0;
+    }
+    return mag;
+}
+
+// Free every round in a magazine back to the heap in one pass
+static void magazine_flush(heap_magazine_t* mag) {
+    while (mag->rounds > 0) {
+        heap_release_block(BLOCK_FROM_PTR(mag->round[--mag->rounds]));
+    }
+}
+
+// Fill an empty magazine with a batch of fresh blocks from the heap
+static int magazine_refill(heap_magazine_t* mag, int class) {
+    size_t size = MIN_ALLOC_SIZE << class;
+    
+    while (mag->rounds < HEAP_MAG_BATCH) {
+        void* ptr = heap_alloc_block(size, HEAP_TAG_CACHED);
+        if (!ptr) {
+            break;
         }
-        
-        heap_manager.blocks_free--;
+        mag->round[mag->rounds++] = ptr;
     }
     
-    // Merge with previous block if free
-    if (block->prev && block->prev->free) {
-        heap_block_t* prev = block->prev;
-        
-        prev->size += sizeof(heap_block_t) + block->size;
-        prev->next = block->next;
-        
-        if (block->next) {
-            block->next->prev = prev;
+    return mag->rounds > 0;
+}
+
+// Under memory pressure, hand every full depot magazine back to the heap
+static int heap_depot_reclaim(void) {
+    int reclaimed = 0;
+    
+    if (!magazines_enabled) {
+        return 0;
+    }
+    
+    for (int class = 0; class < HEAP_MAG_CLASSES; class++) {
+        heap_depot_t* depot = &heap_depot[class];
+        heap_magazine_t* mag;
+        while ((mag = depot_pop(&depot->full)) != NULL) {
+            depot->full_count--;
+            depot->flushes++;
+            magazine_flush(mag);
+            depot_push(&depot->empty, mag);
+            depot->empty_count++;
+            reclaimed = 1;
         }
-        
-        heap_manager.blocks_free--;
     }
+    
+    return reclaimed;
 }
 
-// Enhanced malloc with alignment and validation
-void* heap_malloc(size_t size) {
+// Magazine fast path for allocation
+static void* magazine_alloc(int class, uint32_t tag) {
+    heap_cpu_cache_t* cpu = &heap_cpu_caches[heap_cpu_id()][class];
+    
+    if (cpu->loaded->rounds == 0) {
+        if (cpu->previous->rounds > 0) {
+            // Previous magazine is full: swap it in
+            heap_magazine_t* tmp = cpu->loaded;
+            cpu->loaded = cpu->previous;
+            cpu->previous = tmp;
+        } else {
+            // Both empty: trade the previous one for a full depot magazine
+            heap_depot_t* depot = &heap_depot[class];
+            heap_magazine_t* full = depot_pop(&depot->full);
+            if (full) {
+                depot->full_count--;
+                depot->exchanges++;
+                depot_push(&depot->empty, cpu->previous);
+                depot->empty_count++;
+                cpu->previous = cpu->loaded;
+                cpu->loaded = full;
+            } else {
+                // Depot is dry: refill from the heap in one batch
+                if (!magazine_refill(cpu->loaded, class)) {
+                    return NULL;
+                }
+                depot->refills++;
+            }
+        }
+    } else {
+        cpu->hits++;
+    }
+    
+    void* ptr = cpu->loaded->round[--cpu->loaded->rounds];
+    heap_retag(BLOCK_FROM_PTR(ptr), tag);
+    return ptr;
+}
+
+// Magazine fast path for free; returns 0 if the block must go to the heap
+static int magazine_free(heap_block_t* block, int class) {
+    heap_cpu_cache_t* cpu = &heap_cpu_caches[heap_cpu_id()][class];
+    
+    if (cpu->loaded->rounds == HEAP_MAG_ROUNDS) {
+        if (cpu->previous->rounds == 0) {
+            // Previous magazine is empty: swap it in
+            heap_magazine_t* tmp = cpu->loaded;
+            cpu->loaded = cpu->previous;
+            cpu->previous = tmp;
+        } else {
+            // Both full: park the previous one in the depot for an empty one
+            heap_depot_t* depot = &heap_depot[class];
+            heap_magazine_t* empty = magazine_get_empty(depot);
+            if (!empty) {
+                return 0;
+            }
+            
+            depot_push(&depot->full, cpu->previous);
+            depot->full_count++;
+            depot->exchanges++;
+            cpu->previous = cpu->loaded;
+            cpu->loaded = empty;
+            
+            // Keep the depot bounded so cached blocks can't pin the heap
+            if (depot->full_count > HEAP_DEPOT_MAX_FULL) {
+                heap_magazine_t* surplus = depot_pop(&depot->full);
+                depot->full_count--;
+                depot->flushes++;
+                magazine_flush(surplus);
+                depot_push(&depot->empty, surplus);
+                depot->empty_count++;
+            }
+        }
+    }
+    
+    heap_retag(block, HEAP_TAG_CACHED);
+    cpu->loaded->round[cpu->loaded->rounds++] = BLOCK_PAYLOAD(block);
+    return 1;
+}
+
+// Set up the magazine layer once the slab allocator can hold magazines
+void heap_magazine_init(void) {
+    if (!heap_initialized) {
+        return;
+    }
+    
+    magazine_cache = kmem_cache_create("heap_magazine", sizeof(heap_magazine_t), NULL);
+    if (!magazine_cache) {
+        serial_write_string("HEAP ERROR: Could not create magazine cache\n");
+        return;
+    }
+    
+    memset(heap_depot, 0, sizeof(heap_depot));
+    for (uint32_t cpu = 0; cpu < HEAP_MAX_CPUS; cpu++) {
+        for (int class = 0; class < HEAP_MAG_CLASSES; class++) {
+            heap_cpu_cache_t* cache = &heap_cpu_caches[cpu][class];
+            cache->loaded = magazine_get_empty(&heap_depot[class]);
+            cache->previous = magazine_get_empty(&heap_depot[class]);
+            cache->hits = 0;
+            if (!cache->loaded || !cache->previous) {
+                serial_write_string("HEAP ERROR: Could not allocate magazines\n");
+                return;
+            }
+        }
+    }
+    
+    magazines_enabled = 1;
+    serial_write_string("Heap magazine layer enabled\n");
+}
+
+// Allocation shared by every public entry point; caller has interrupts off
+static void* heap_malloc_locked(size_t size, uint32_t tag) {
     if (!heap_initialized) {
         return NULL;
     }
@@ -135,6 +653,10 @@ void* heap_malloc(size_t size) {
         return NULL;
     }
     
+    if (tag >= HEAP_TAG_COUNT || tag == HEAP_TAG_CACHED) {
+        tag = HEAP_TAG_KERNEL;
+    }
+    
     // Align size to 8-byte boundary
     size = memory_align_up(size, 8);
     
@@ -143,54 +665,206 @@ void* heap_malloc(size_t size) {
         size = MIN_ALLOC_SIZE;
     }
     
-    // Find best-fit block
-    heap_block_t* block = find_best_fit(size);
+    // Small requests are rounded to a size class and served by the magazines
+    int class = mag_class_of_size(size);
+    if (magazines_enabled && class >= 0) {
+        void* ptr = magazine_alloc(class, tag);
+        if (ptr) {
+            return ptr;
+        }
+        size = MIN_ALLOC_SIZE << class;
+    }
+    
+    return heap_alloc_block(size, tag);
+}
+
+// Free lists, magazines and the depot are only touched with interrupts
+// off, so a preempting process never sees them half updated
+// Malloc charged to a tag, attributed to an explicit call site; wrappers
+// such as libc malloc pass their own caller here
+void* heap_malloc_tagged_at(size_t size, uint32_t tag, void* site) {
+    uint32_t flags = irq_save();
+    void* ptr = heap_malloc_locked(size, tag);
+    HEAP_PROFILE_RECORD(HEAP_PROF_ALLOC, ptr, size, site);
+    irq_restore(flags);
+    return ptr;
+}
+
+// Enhanced malloc with alignment and validation
+void* heap_malloc(size_t size) {
+    return heap_malloc_tagged_at(size, HEAP_TAG_KERNEL, __builtin_return_address(0));
+}
+
+// Malloc charged to a subsystem's accounting tag
+void* heap_malloc_tagged(size_t size, uint32_t tag) {
+    return heap_malloc_tagged_at(size, tag, __builtin_return_address(0));
+}
+
+// Find the best-fitting free block that can hold `size` bytes at an aligned
+// payload address; *gap receives the distance from its payload to that address
+static heap_block_t* find_aligned_fit(size_t size, size_t alignment, size_t* gap) {
+    heap_block_t* best = NULL;
+    size_t best_size = SIZE_MAX;
+    
+    for (heap_block_t* current = heap_manager.free_list; current; current = BLOCK_LINKS(current)->next) {
+        if (current->size < size || current->size >= best_size) {
+            continue;
+        }
+        
+        // A front gap must be big enough to become a free block of its own
+        uint32_t payload = (uint32_t)BLOCK_PAYLOAD(current);
+        uint32_t aligned = memory_align_up(payload, alignment);
+        while (aligned != payload && aligned - payload < HEAP_OVERHEAD + MIN_ALLOC_SIZE) {
+            aligned += alignment;
+        }
+        
+        if (current->size >= (aligned - payload) + size) {
+            best = current;
+            best_size = current->size;
+            *gap = aligned - payload;
+        }
+    }
+    
+    return best;
+}
+
+// Allocate with the payload aligned to a power-of-two boundary; caller
+// has interrupts off
+static void* heap_memalign_locked(size_t alignment, size_t size, uint32_t tag) {
+    if (!heap_initialized || size == 0) {
+        return NULL;
+    }
+    
+    // Alignment must be a power of two
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    
+    // Every block is already 8-byte aligned
+    if (alignment <= 8) {
+        return heap_malloc_locked(size, tag);
+    }
+    
+    if (tag >= HEAP_TAG_COUNT || tag == HEAP_TAG_CACHED) {
+        tag = HEAP_TAG_KERNEL;
+    }
+    
+    size = memory_align_up(size, 8);
+    if (size < MIN_ALLOC_SIZE) {
+        size = MIN_ALLOC_SIZE;
+    }
+    
+    // Find a block with room for the gap, growing the heap if nothing fits
+    size_t gap = 0;
+    heap_block_t* block = find_aligned_fit(size, alignment, &gap);
     if (!block) {
-        return NULL; // Out of memory
+        if (!heap_grow(size + alignment + 2 * HEAP_OVERHEAD + MIN_ALLOC_SIZE) &&
+            !heap_depot_reclaim()) {
+            return NULL; // Out of memory
+        }
+        block = find_aligned_fit(size, alignment, &gap);
+        if (!block) {
+            return NULL;
+        }
     }
     
-    // Split block if necessary
+    free_list_remove(block);
+    
+    // Return the front slack to the free list as its own block
+    if (gap > 0) {
+        size_t total = block->size;
+        set_block(block, gap - HEAP_OVERHEAD, HEAP_MAGIC_FREE);
+        free_list_insert(block);
+        
+        block = next_block(block);
+        set_block(block, total - gap, HEAP_MAGIC_FREE);
+        heap_manager.blocks_free++;
+    }
+    
+    // Return the back slack as usual
     split_block(block, size);
     
     // Mark block as allocated
-    block->free = 0;
-    block->magic = HEAP_MAGIC_ALLOCATED;
+    set_block(block, block->size, HEAP_MAGIC_ALLOCATED | tag);
     
     // Update statistics
     heap_manager.blocks_allocated++;
     heap_manager.blocks_free--;
-    heap_manager.free_size -= (size + sizeof(heap_block_t));
+    heap_manager.free_size -= (block->size + HEAP_OVERHEAD);
+    heap_manager.tag_bytes[tag] += block->size;
+    heap_manager.tag_blocks[tag]++;
     
-    // Return pointer to user data
-    return (void*)((char*)block + sizeof(heap_block_t));
+    return BLOCK_PAYLOAD(block);
 }
 
-// Enhanced free with validation
-void heap_free(void* ptr) {
+// Aligned malloc charged to a tag, attributed to an explicit call site
+void* heap_memalign_tagged_at(size_t alignment, size_t size, uint32_t tag, void* site) {
+    uint32_t flags = irq_save();
+    void* ptr = heap_memalign_locked(alignment, size, tag);
+    HEAP_PROFILE_RECORD(HEAP_PROF_ALLOC, ptr, size, site);
+    irq_restore(flags);
+    return ptr;
+}
+
+// Aligned malloc for page tables, DMA descriptors and other aligned buffers
+void* heap_memalign(size_t alignment, size_t size) {
+    return heap_memalign_tagged_at(alignment, size, HEAP_TAG_KERNEL, __builtin_return_address(0));
+}
+
+// Aligned malloc charged to a subsystem's accounting tag
+void* heap_memalign_tagged(size_t alignment, size_t size, uint32_t tag) {
+    return heap_memalign_tagged_at(alignment, size, tag, __builtin_return_address(0));
+}
+
+// Free with validation; caller has interrupts off
+static void heap_free_locked(void* ptr, void* site) {
     if (!ptr || !heap_initialized) {
         return;
     }
     
     // Get block header
-    heap_block_t* block = (heap_block_t*)((char*)ptr - sizeof(heap_block_t));
+    heap_block_t* block = BLOCK_FROM_PTR(ptr);
     
     // Validate magic number
-    if (block->magic != HEAP_MAGIC_ALLOCATED) {
+    if (!BLOCK_IS_USED(block) || BLOCK_TAG(block) >= HEAP_TAG_COUNT) {
         serial_write_string("HEAP ERROR: Invalid magic number in free()\n");
         return;
     }
     
-    // Mark block as free
-    block->free = 1;
-    block->magic = HEAP_MAGIC_FREE;
+    // A block sitting in a magazine has already been freed
+    if (BLOCK_TAG(block) == HEAP_TAG_CACHED) {
+        serial_write_string("HEAP ERROR: Double free detected\n");
+        return;
+    }
     
-    // Update statistics
-    heap_manager.blocks_allocated--;
-    heap_manager.blocks_free++;
-    heap_manager.free_size += (block->size + sizeof(heap_block_t));
+    // Validate footer to catch buffer overruns
+    heap_footer_t* footer = BLOCK_FOOTER(block);
+    if (footer->magic != HEAP_MAGIC_FOOTER || footer->size != block->size) {
+        serial_write_string("HEAP ERROR: Corrupted footer in free()\n");
+        return;
+    }
     
-    // Merge with adjacent free blocks
-    merge_free_blocks(block);
+    HEAP_PROFILE_RECORD(HEAP_PROF_FREE, ptr, block->size, site);
+    
+    // Small blocks go back to this CPU's magazine
+    int class = mag_class_of_block(block->size);
+    if (magazines_enabled && class >= 0 && magazine_free(block, class)) {
+        return;
+    }
+    
+    heap_release_block(block);
+}
+
+// Free attributed to an explicit call site
+void heap_free_at(void* ptr, void* site) {
+    uint32_t flags = irq_save();
+    heap_free_locked(ptr, site);
+    irq_restore(flags);
+}
+
+// Enhanced free with validation
+void heap_free(void* ptr) {
+    heap_free_at(ptr, __builtin_return_address(0));
 }
 
 // Enhanced calloc
@@ -202,7 +876,7 @@ void* heap_calloc(size_t nmemb, size_t size) {
         return NULL;
     }
     
-    void* ptr = heap_malloc(total_size);
+    void* ptr = heap_malloc_tagged_at(total_size, HEAP_TAG_KERNEL, __builtin_return_address(0));
     if (ptr) {
         memset(ptr, 0, total_size);
     }
@@ -210,22 +884,85 @@ void* heap_calloc(size_t nmemb, size_t size) {
     return ptr;
 }
 
-// Enhanced realloc
-void* heap_realloc(void* ptr, size_t size) {
+// Give the tail of an allocated block beyond `size` back to the free lists
+static void shrink_block(heap_block_t* block, size_t size) {
+    size_t excess = block->size - size;
+    if (excess == 0) {
+        return;
+    }
+    
+    heap_block_t* next = next_block(block);
+    if (next && BLOCK_IS_FREE(next)) {
+        // Slide the free neighbour's header down over the excess
+        size_t next_size = next->size + excess;
+        free_list_remove(next);
+        set_block(block, size, block->magic);
+        heap_block_t* moved = next_block(block);
+        set_block(moved, next_size, HEAP_MAGIC_FREE);
+        free_list_insert(moved);
+    } else if (excess >= HEAP_OVERHEAD + MIN_ALLOC_SIZE) {
+        // Split off a new free block
+        set_block(block, size, block->magic);
+        heap_block_t* tail = next_block(block);
+        set_block(tail, excess - HEAP_OVERHEAD, HEAP_MAGIC_FREE);
+        free_list_insert(tail);
+        heap_manager.blocks_free++;
+    } else {
+        return; // Too small to be useful on its own
+    }
+    
+    heap_manager.tag_bytes[BLOCK_TAG(block)] -= excess;
+    heap_manager.free_size += excess;
+}
+
+// Grow an allocated block in place by absorbing its free physical successor
+static int expand_block(heap_block_t* block, size_t size) {
+    size_t needed = size - block->size;
+    heap_block_t* next = next_block(block);
+    size_t available = (next && BLOCK_IS_FREE(next)) ? next->size + HEAP_OVERHEAD : 0;
+    
+    // At the end of the heap, map more pages right behind the block
+    if (available < needed && (!next || (available && !next_block(next)))) {
+        if (heap_grow(needed - available + HEAP_OVERHEAD)) {
+            next = next_block(block);
+            available = next->size + HEAP_OVERHEAD;
+        }
+    }
+    
+    if (available < needed) {
+        return 0;
+    }
+    
+    free_list_remove(next);
+    heap_manager.blocks_free--;
+    heap_manager.free_size -= available;
+    heap_manager.tag_bytes[BLOCK_TAG(block)] += available;
+    set_block(block, block->size + available, block->magic);
+    
+    // Return whatever we absorbed beyond the request
+    shrink_block(block, size);
+    return 1;
+}
+
+// Realloc that grows or shrinks in place whenever the layout allows;
+// caller has interrupts off
+static void* heap_realloc_locked(void* ptr, size_t size, void* site) {
     if (!ptr) {
-        return heap_malloc(size);
+        ptr = heap_malloc_locked(size, HEAP_TAG_KERNEL);
+        HEAP_PROFILE_RECORD(HEAP_PROF_ALLOC, ptr, size, site);
+        return ptr;
     }
     
     if (size == 0) {
-        heap_free(ptr);
+        heap_free_locked(ptr, site);
         return NULL;
     }
     
     // Get current block
-    heap_block_t* block = (heap_block_t*)((char*)ptr - sizeof(heap_block_t));
+    heap_block_t* block = BLOCK_FROM_PTR(ptr);
     
-    // Validate magic number
-    if (block->magic != HEAP_MAGIC_ALLOCATED) {
+    // Validate magic number; cached blocks were already freed
+    if (!BLOCK_IS_USED(block) || BLOCK_TAG(block) == HEAP_TAG_CACHED) {
         return NULL;
     }
     
@@ -235,13 +972,22 @@ void* heap_realloc(void* ptr, size_t size) {
         size = MIN_ALLOC_SIZE;
     }
     
-    // If new size fits in current block, just return
+    // Shrink: split off and return the tail
     if (size <= block->size) {
+        shrink_block(block, size);
+        heap_trim();
+        HEAP_PROFILE_RECORD(HEAP_PROF_REALLOC, ptr, size, site);
+        return ptr;
+    }
+    
+    // Grow into a free neighbour without copying
+    if (expand_block(block, size)) {
+        HEAP_PROFILE_RECORD(HEAP_PROF_REALLOC, ptr, size, site);
         return ptr;
     }
     
-    // Allocate new block
-    void* new_ptr = heap_malloc(size);
+    // Allocate new block charged to the same subsystem
+    void* new_ptr = heap_malloc_locked(size, BLOCK_TAG(block));
     if (!new_ptr) {
         return NULL;
     }
@@ -250,11 +996,235 @@ void* heap_realloc(void* ptr, size_t size) {
     memcpy(new_ptr, ptr, block->size);
     
     // Free old block
-    heap_free(ptr);
+    heap_free_locked(ptr, site);
     
+    HEAP_PROFILE_RECORD(HEAP_PROF_REALLOC, new_ptr, size, site);
     return new_ptr;
 }
 
+// Realloc attributed to an explicit call site
+void* heap_realloc_at(void* ptr, size_t size, void* site) {
+    uint32_t flags = irq_save();
+    void* new_ptr = heap_realloc_locked(ptr, size, site);
+    irq_restore(flags);
+    return new_ptr;
+}
+
+// Enhanced realloc: grows or shrinks in place whenever the layout allows
+void* heap_realloc(void* ptr, size_t size) {
+    return heap_realloc_at(ptr, size, __builtin_return_address(0));
+}
+
+// Power-of-two bucket for a size: 0 holds everything up to 32 bytes
+static uint8_t heap_size_bucket(size_t size) {
+    uint8_t bucket = 0;
+    while (bucket < HEAP_HIST_BUCKETS - 1 && ((size_t)MIN_ALLOC_SIZE << bucket) < size) {
+        bucket++;
+    }
+    return bucket;
+}
+
+#ifdef HEAP_PROFILE
+// Per-site totals gathered from the ring buffer
+typedef struct heap_prof_site {
+    void* site;
+    uint32_t bytes;
+    uint32_t count;
+    uint32_t live_bytes;             // Allocated in the window and not yet freed
+} heap_prof_site_t;
+
+static heap_prof_site_t heap_prof_sites[HEAP_PROF_SITES];
+
+// Print the top sites ordered by bytes (by_bytes) or by count
+static void heap_profile_print_top(uint32_t site_count, int by_bytes) {
+    char buffer[32];
+    uint8_t printed[HEAP_PROF_SITES];
+    memset(printed, 0, sizeof(printed));
+    
+    for (uint32_t rank = 0; rank < HEAP_PROF_TOP && rank < site_count; rank++) {
+        uint32_t best = site_count;
+        for (uint32_t i = 0; i < site_count; i++) {
+            if (printed[i]) {
+                continue;
+            }
+            uint32_t key = by_bytes ? heap_prof_sites[i].bytes : heap_prof_sites[i].count;
+            uint32_t best_key = best < site_count ?
+                (by_bytes ? heap_prof_sites[best].bytes : heap_prof_sites[best].count) : 0;
+            if (best == site_count || key > best_key) {
+                best = i;
+            }
+        }
+        printed[best] = 1;
+        
+        serial_write_string("  0x");
+        itoa((uint32_t)heap_prof_sites[best].site, buffer, 16);
+        serial_write_string(buffer);
+        serial_write_string(": ");
+        itoa(heap_prof_sites[best].bytes, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string(" bytes, ");
+        itoa(heap_prof_sites[best].count, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string(" allocs, ");
+        itoa(heap_prof_sites[best].live_bytes, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string(" live\n");
+    }
+}
+
+// Summarize the ring buffer by call site
+static void heap_profile_print_sites(void) {
+    char buffer[32];
+    uint32_t events = heap_prof_head < HEAP_PROF_EVENTS ? heap_prof_head : HEAP_PROF_EVENTS;
+    uint32_t first = heap_prof_head - events;
+    uint32_t site_count = 0;
+    uint32_t dropped = 0;
+    
+    for (uint32_t n = first; n < heap_prof_head; n++) {
+        heap_prof_event_t* event = &heap_prof_ring[n % HEAP_PROF_EVENTS];
+        if (event->op == HEAP_PROF_FREE) {
+            continue;
+        }
+        
+        // Live unless a later free or realloc in the window touched the pointer
+        int live = 1;
+        for (uint32_t m = n + 1; m < heap_prof_head; m++) {
+            heap_prof_event_t* later = &heap_prof_ring[m % HEAP_PROF_EVENTS];
+            if (later->ptr == event->ptr && later->op != HEAP_PROF_ALLOC) {
+                live = 0;
+                break;
+            }
+        }
+        
+        uint32_t i = 0;
+        while (i < site_count && heap_prof_sites[i].site != event->site) {
+            i++;
+        }
+        if (i == site_count) {
+            if (site_count == HEAP_PROF_SITES) {
+                dropped++;
+                continue;
+            }
+            heap_prof_sites[i].site = event->site;
+            heap_prof_sites[i].bytes = 0;
+            heap_prof_sites[i].count = 0;
+            heap_prof_sites[i].live_bytes = 0;
+            site_count++;
+        }
+        
+        heap_prof_sites[i].bytes += event->size;
+        heap_prof_sites[i].count++;
+        if (live) {
+            heap_prof_sites[i].live_bytes += event->size;
+        }
+    }
+    
+    serial_write_string("Events in window: ");
+    itoa(events, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" (ticks ");
+    itoa(events ? heap_prof_ring[first % HEAP_PROF_EVENTS].tick : 0, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("-");
+    itoa(events ? heap_prof_ring[(heap_prof_head - 1) % HEAP_PROF_EVENTS].tick : 0, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(")\n");
+    
+    serial_write_string("Top sites by bytes:\n");
+    heap_profile_print_top(site_count, 1);
+    serial_write_string("Top sites by count:\n");
+    heap_profile_print_top(site_count, 0);
+    
+    if (dropped) {
+        serial_write_string("Events from untracked sites: ");
+        itoa(dropped, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("\n");
+    }
+}
+#endif
+
+// Print the heap profile: call sites, live-object histogram, fragmentation
+void heap_profile_report(void) {
+    char buffer[32];
+    
+    if (!heap_initialized) {
+        return;
+    }
+    
+    serial_write_string("\n=== HEAP PROFILE ===\n");
+    
+#ifdef HEAP_PROFILE
+    heap_profile_print_sites();
+#else
+    serial_write_string("Call-site tracking not built in (make HEAP_PROFILE=1)\n");
+#endif
+    
+    // Live objects by size, from a walk of every block
+    uint32_t histogram[HEAP_HIST_BUCKETS];
+    memset(histogram, 0, sizeof(histogram));
+    for (heap_block_t* block = (heap_block_t*)heap_manager.heap_start; block; block = next_block(block)) {
+        if (BLOCK_IS_USED(block) && BLOCK_TAG(block) != HEAP_TAG_CACHED) {
+            histogram[heap_size_bucket(block->size)]++;
+        }
+    }
+    
+    serial_write_string("Live objects by size:\n");
+    for (uint32_t bucket = 0; bucket < HEAP_HIST_BUCKETS; bucket++) {
+        if (!histogram[bucket]) {
+            continue;
+        }
+        if (bucket == HEAP_HIST_BUCKETS - 1) {
+            serial_write_string("  > ");
+            itoa(MIN_ALLOC_SIZE << (bucket - 1), buffer, 10);
+        } else {
+            serial_write_string("  <= ");
+            itoa(MIN_ALLOC_SIZE << bucket, buffer, 10);
+        }
+        serial_write_string(buffer);
+        serial_write_string(": ");
+        itoa(histogram[bucket], buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("\n");
+    }
+    
+    // Fragmentation index: share of free memory outside the largest free block
+    size_t largest = 0;
+    size_t total_free = 0;
+    for (heap_block_t* block = heap_manager.free_list; block; block = BLOCK_LINKS(block)->next) {
+        total_free += block->size;
+        if (block->size > largest) {
+            largest = block->size;
+        }
+    }
+    
+    serial_write_string("Largest free block: ");
+    itoa(largest, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" of ");
+    itoa(total_free, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" bytes free\n");
+    
+    // Divide first so the percentage can't overflow 32 bits on a large heap
+    uint32_t contiguous = 100;
+    if (total_free >= 100) {
+        contiguous = largest / (total_free / 100);
+    } else if (total_free > 0) {
+        contiguous = (largest * 100) / total_free;
+    }
+    if (contiguous > 100) {
+        contiguous = 100;
+    }
+    
+    serial_write_string("Fragmentation index: ");
+    itoa(100 - contiguous, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("%\n");
+    
+    serial_write_string("====================\n");
+}
+
 // Print heap statistics
 void heap_print_stats(void) {
     char buffer[32];
@@ -286,13 +1256,64 @@ void heap_print_stats(void) {
     serial_write_string(buffer);
     serial_write_string("\n");
     
-    // Calculate fragmentation
-    uint32_t usage_percent = ((heap_manager.total_size - heap_manager.free_size) * 100) / heap_manager.total_size;
+    // Calculate usage; divide first so a heap past 42MB can't overflow
+    uint32_t used = heap_manager.total_size - heap_manager.free_size;
+    uint32_t usage_percent = 0;
+    if (heap_manager.total_size >= 100) {
+        usage_percent = used / (heap_manager.total_size / 100);
+    } else if (heap_manager.total_size > 0) {
+        usage_percent = (used * 100) / heap_manager.total_size;
+    }
+    if (usage_percent > 100) {
+        usage_percent = 100;
+    }
     serial_write_string("Usage: ");
     itoa(usage_percent, buffer, 10);
     serial_write_string(buffer);
     serial_write_string("%\n");
     
+    // Per-subsystem accounting
+    serial_write_string("Usage by subsystem:\n");
+    for (uint32_t tag = 0; tag < HEAP_TAG_COUNT; tag++) {
+        serial_write_string("  ");
+        serial_write_string(heap_tag_names[tag]);
+        serial_write_string(": ");
+        itoa(heap_manager.tag_bytes[tag], buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string(" bytes in ");
+        itoa(heap_manager.tag_blocks[tag], buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string(" blocks\n");
+    }
+    
+    // Magazine layer activity per size class
+    if (magazines_enabled) {
+        serial_write_string("Magazines (size: hits exchanges refills flushes):\n");
+        for (int class = 0; class < HEAP_MAG_CLASSES; class++) {
+            uint32_t hits = 0;
+            for (uint32_t cpu = 0; cpu < HEAP_MAX_CPUS; cpu++) {
+                hits += heap_cpu_caches[cpu][class].hits;
+            }
+            
+            serial_write_string("  ");
+            itoa(MIN_ALLOC_SIZE << class, buffer, 10);
+            serial_write_string(buffer);
+            serial_write_string(": ");
+            itoa(hits, buffer, 10);
+            serial_write_string(buffer);
+            serial_write_string(" ");
+            itoa(heap_depot[class].exchanges, buffer, 10);
+            serial_write_string(buffer);
+            serial_write_string(" ");
+            itoa(heap_depot[class].refills, buffer, 10);
+            serial_write_string(buffer);
+            serial_write_string(" ");
+            itoa(heap_depot[class].flushes, buffer, 10);
+            serial_write_string(buffer);
+            serial_write_string("\n");
+        }
+    }
+    
     serial_write_string("======================\n");
 }
 
@@ -302,39 +1323,74 @@ int heap_validate(void) {
         return 0;
     }
     
-    heap_block_t* current = heap_manager.first_block;
+    heap_block_t* current = (heap_block_t*)heap_manager.heap_start;
     int block_count = 0;
+    uint32_t free_count = 0;
+    int prev_free = 0;
     int errors = 0;
+    char buffer[16];
     
+    // Walk every block in address order using the size tags
     while (current) {
         block_count++;
         
+        // Check bounds
+        if ((char*)current < (char*)heap_manager.heap_start || 
+            (char*)BLOCK_FOOTER(current) + HEAP_FOOTER_SIZE > (char*)heap_manager.heap_end) {
+            serial_write_string("HEAP ERROR: Block out of bounds\n");
+            errors++;
+            break;
+        }
+        
         // Check magic number
-        uint32_t expected_magic = current->free ? HEAP_MAGIC_FREE : HEAP_MAGIC_ALLOCATED;
-        if (current->magic != expected_magic) {
+        if (!BLOCK_IS_FREE(current) && !BLOCK_IS_USED(current)) {
             serial_write_string("HEAP ERROR: Invalid magic in block ");
-            char buffer[16];
             itoa(block_count, buffer, 10);
             serial_write_string(buffer);
             serial_write_string("\n");
             errors++;
+            break;
         }
         
-        // Check bounds
-        if ((char*)current < (char*)heap_manager.heap_start || 
-            (char*)current >= (char*)heap_manager.heap_end) {
-            serial_write_string("HEAP ERROR: Block out of bounds\n");
+        // Footer must mirror the header
+        heap_footer_t* footer = BLOCK_FOOTER(current);
+        if (footer->magic != HEAP_MAGIC_FOOTER || footer->size != current->size) {
+            serial_write_string("HEAP ERROR: Footer mismatch in block ");
+            itoa(block_count, buffer, 10);
+            serial_write_string(buffer);
+            serial_write_string("\n");
             errors++;
         }
         
-        current = current->next;
+        // Coalescing must never leave two free neighbours
+        if (BLOCK_IS_FREE(current)) {
+            if (prev_free) {
+                serial_write_string("HEAP ERROR: Uncoalesced free blocks\n");
+                errors++;
+            }
+            free_count++;
+        }
+        prev_free = BLOCK_IS_FREE(current);
         
-        // Prevent infinite loops
-        if (block_count > 10000) {
-            serial_write_string("HEAP ERROR: Possible infinite loop\n");
+        current = next_block(current);
+    }
+    
+    // Every free block must be reachable from the free list
+    uint32_t list_count = 0;
+    current = heap_manager.free_list;
+    while (current && list_count <= free_count) {
+        if (!BLOCK_IS_FREE(current)) {
+            serial_write_string("HEAP ERROR: Allocated block on free list\n");
             errors++;
             break;
         }
+        list_count++;
+        current = BLOCK_LINKS(current)->next;
+    }
+    
+    if (list_count != free_count || free_count != heap_manager.blocks_free) {
+        serial_write_string("HEAP ERROR: Free list out of sync\n");
+        errors++;
     }
     
     if (errors == 0) {
@@ -342,4 +1398,4 @@ int heap_validate(void) {
     }
     
     return errors == 0;
-} 
\ No newline at end of file
+}
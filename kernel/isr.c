@@ -75,13 +75,8 @@ void register_interrupt_handler(uint8_t n, isr_t handler) {
 
 // Interrupt handler which dispatches to the registered handlers
 void isr_handler(registers_t regs) {
-    // If we registered a handler, call it
-    if (interrupt_handlers[regs.int_no]) {
-        isr_t handler = interrupt_handlers[regs.int_no];
-        handler(regs);
-    }
-    
-    // If this is a hardware interrupt, send EOI to the PIC
+    // If this is a hardware interrupt, send EOI to the PIC first: the
+    // handler may switch to another process and not return for a while
     if (regs.int_no >= 32 && regs.int_no < 48) {
         // If IRQ8-15, send to slave PIC as well
         if (regs.int_no >= 40) {
@@ -89,4 +84,10 @@ void isr_handler(registers_t regs) {
         }
         outb(0x20, 0x20);      // Primary PIC EOI
     }
+    
+    // If we registered a handler, call it
+    if (interrupt_handlers[regs.int_no]) {
+        isr_t handler = interrupt_handlers[regs.int_no];
+        handler(regs);
+    }
 } 
\ No newline at end of file
@@ -12,6 +12,7 @@
 #include "memory.h"
 #include "process.h"
 #include "timer.h"
+#include "sync.h"
 #include "disk.h"
 #include "utils.h"
 #include "syscall.h"
@@ -312,6 +313,38 @@ void execute_command(const char* command) {
         cursor_col = 2;
         k_print_string("meminfo  - Display memory information", WHITE_ON_BLACK, cursor_row, cursor_col);
         
+        cursor_row++;
+        cursor_col = 2;
+        k_print_string("heapprof - Show heap allocation profile", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        cursor_row++;
+        cursor_col = 2;
+        k_print_string("pmmbench - Benchmark physical frame allocation", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        cursor_row++;
+        cursor_col = 2;
+        k_print_string("membench - Compare 4MB and 4KB page walks", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        cursor_row++;
+        cursor_col = 2;
+        k_print_string("tlbbench - Time kernel accesses after page directory switches", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        cursor_row++;
+        cursor_col = 2;
+        k_print_string("spawntest - Spawn, COW-copy and destroy processes, check for leaks", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        cursor_row++;
+        cursor_col = 2;
+        k_print_string("switchbench - Measure context switches per second", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        cursor_row++;
+        cursor_col = 2;
+        k_print_string("sleepbench - Measure idle time while processes sleep", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        cursor_row++;
+        cursor_col = 2;
+        k_print_string("synctest - Producer/consumer over mutex, condvar, semaphore", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
         cursor_row++;
         cursor_col = 2;
         k_print_string("diskinfo - Display disk information", WHITE_ON_BLACK, cursor_row, cursor_col);
@@ -818,11 +851,69 @@ void execute_command(const char* command) {
         
         // Print memory information to serial
         heap_print_stats();
-        serial_write_string("Free physical frames: ");
-        char buffer[32];
-        itoa(pmm_get_free_frames(), buffer, 10);
-        serial_write_string(buffer);
-        serial_write_string("\n");
+        kmem_print_stats();
+        pmm_print_stats();
+    }
+    else if (strcmp(command, "heapprof") == 0) {
+        cursor_row++;
+        cursor_col = 0;
+        k_print_string("Heap profile printed to serial port", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        // Print call sites, live-object histogram and fragmentation to serial
+        heap_profile_report();
+    }
+    else if (strcmp(command, "pmmbench") == 0) {
+        cursor_row++;
+        cursor_col = 0;
+        k_print_string("PMM benchmark results printed to serial port", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        // Allocate and free every frame, timing both passes
+        pmm_benchmark();
+    }
+    else if (strcmp(command, "membench") == 0) {
+        cursor_row++;
+        cursor_col = 0;
+        k_print_string("Memory walk benchmark printed to serial port", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        // Walk the same 4MB through a large page and through 4KB pages
+        vmm_benchmark();
+    }
+    else if (strcmp(command, "tlbbench") == 0) {
+        cursor_row++;
+        cursor_col = 0;
+        k_print_string("TLB benchmark results printed to serial port", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        // Switch between two address spaces with and without global pages
+        vmm_switch_benchmark();
+    }
+    else if (strcmp(command, "spawntest") == 0) {
+        cursor_row++;
+        cursor_col = 0;
+        k_print_string("Spawn/exit stress results printed to serial port", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        // 100 create/COW-copy/destroy rounds; free frames must not drift
+        process_stress_test(100);
+    }
+    else if (strcmp(command, "switchbench") == 0) {
+        cursor_row++;
+        cursor_col = 0;
+        k_print_string("Context switch benchmark printed to serial port", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        scheduler_benchmark();
+    }
+    else if (strcmp(command, "sleepbench") == 0) {
+        cursor_row++;
+        cursor_col = 0;
+        k_print_string("Sleep benchmark printed to serial port", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        scheduler_sleep_benchmark();
+    }
+    else if (strcmp(command, "synctest") == 0) {
+        cursor_row++;
+        cursor_col = 0;
+        k_print_string("Synchronization self-test printed to serial port", WHITE_ON_BLACK, cursor_row, cursor_col);
+        
+        sync_self_test();
     }
     else if (strcmp(command, "diskinfo") == 0) {
         cursor_row++;
@@ -939,9 +1030,6 @@ void execute_command(const char* command) {
         graphics_draw_string(10, 40, "Press any key to return", COLOR_LIGHT_GRAY);
         
         // Wait for key press
-        while (keyboard_buffer_empty()) {
-            asm("hlt");
-        }
         keyboard_getchar(); // consume the key
         
         // Return to text mode
@@ -989,9 +1077,6 @@ void execute_command(const char* command) {
         graphics_draw_string(100, 90, "Graphics Test Complete!", COLOR_YELLOW);
         
         // Wait for key
-        while (keyboard_buffer_empty()) {
-            asm("hlt");
-        }
         keyboard_getchar();
         
         // Return to text mode
@@ -1098,9 +1183,12 @@ void kernel_main() {
     // Initialize physical memory manager
     k_print_string("Initializing memory management...", WHITE_ON_BLACK, 3, 0);
     serial_write_string("Initializing memory subsystems...\n");
-    pmm_init();
+    pmm_init((const e820_map_t*)E820_MAP_ADDRESS); // Collected by the bootloader
     vmm_init();
-    heap_init((void*)0x800000, 0x400000); // 4MB heap at 8MB
+    vmm_enable_paging();
+    heap_init((void*)KERNEL_HEAP_START, KERNEL_HEAP_INITIAL); // Grows on demand
+    kmem_init();
+    heap_magazine_init();
     
     // Initialize timer for scheduling
     k_print_string("Initializing system timer...", WHITE_ON_BLACK, 4, 0);
@@ -1113,7 +1201,9 @@ void kernel_main() {
     // Initialize process management
     k_print_string("Initializing process management...", WHITE_ON_BLACK, 6, 0);
     process_init();
+    vma_init();
     scheduler_init();
+    enable_multitasking();
     
     // Initialize keyboard
     k_print_string("Initializing keyboard...", WHITE_ON_BLACK, 7, 0);
@@ -1173,13 +1263,8 @@ void kernel_main() {
     
     // Main kernel loop
     while (1) {
-        // Check for keyboard input (non-blocking)
-        if (!keyboard_buffer_empty()) {
-            char c = keyboard_getchar();
-            shell_handle_input(c);
-        }
-        
-        // Halt until next interrupt to save CPU
-        asm("hlt");
+        // Sleeps until a key arrives; the idle thread pre-zeroes frames meanwhile
+        char c = keyboard_getchar();
+        shell_handle_input(c);
     }
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 section .text
 global _start               ; Make _start globally visible
 extern kernel_main          ; Declare external C function
+extern __bss_start          ; BSS bounds from the default linker script
+extern _end
 
 _start:
     ; Set up segment registers with proper data segment
@@ -24,6 +26,13 @@ _start:
     ; Clear direction flag for string operations
     cld
     
+    ; Zero the BSS; it can extend past the sectors the bootloader reads
+    mov edi, __bss_start
+    mov ecx, _end
+    sub ecx, edi
+    xor eax, eax
+    rep stosb
+    
     ; Write a visible pattern to video memory to show we got here
     mov eax, 0xB8000        ; VGA text mode address
     mov word [eax], 0x0F41  ; White 'A' on black background
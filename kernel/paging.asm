@@ -16,14 +16,15 @@ vmm_load_page_directory:
     pop ebp
     ret
 
-; Enable paging by setting PG bit in CR0
+; Enable paging by setting PG bit in CR0, plus WP so kernel writes also
+; fault on read-only (copy-on-write) user pages
 global vmm_enable_paging_asm
 vmm_enable_paging_asm:
     push ebp
     mov ebp, esp
     
     mov eax, cr0
-    or eax, 0x80000000  ; Set PG (paging) bit
+    or eax, 0x80010000  ; Set PG (paging) and WP (write protect) bits
     mov cr0, eax
     
     pop ebp
@@ -67,4 +67,17 @@ void irq_clear_mask(uint8_t irq) {
     
     value = inb(port) & ~(1 << irq);
     outb(port, value);
-} 
\ No newline at end of file
+} 
+
+// Whether an IRQ has been raised but not yet delivered (its IRR bit)
+int irq_pending(uint8_t irq) {
+    uint16_t port = PIC1_COMMAND;
+    
+    if (irq >= 8) {
+        port = PIC2_COMMAND;
+        irq -= 8;
+    }
+    
+    outb(port, OCW3_READ_IRR);
+    return (inb(port) >> irq) & 1;
+}
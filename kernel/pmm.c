@@ -2,115 +2,567 @@
 #include "../include/libc/string.h"
 #include "../include/serial.h"
 #include "../include/utils.h"
+#include "../include/cpu.h"
 
 // Physical memory manager instance
 static physical_memory_manager_t pmm;
 
 // Memory starts after kernel (2MB for safety)
 #define MEMORY_START 0x200000
-#define MEMORY_SIZE  0x1E00000  // 30MB available (total 32MB assumed)
+#define MEMORY_SIZE  0x1E00000  // 30MB, assumed only when the BIOS gives no E820 map
 
-// Initialize physical memory manager
-void pmm_init(void) {
+// Frames must be reachable through the physical linear map
+#define MEMORY_LIMIT PHYS_MAP_LIMIT
+
+// Frames zeroed ahead of time by the idle loop; each one is an allocated
+// order-0 block owned by the pool until pmm_alloc_zeroed_frame hands it out
+static uint32_t zero_pool[PMM_ZERO_POOL_SIZE];
+static uint32_t zero_pool_count = 0;
+
+static int zero_pool_drain(void);
+
+// Single-region map used when E820 detection failed
+static e820_map_t fallback_map = {
+    1, { { MEMORY_START, MEMORY_SIZE, MEMORY_REGION_AVAILABLE, 1 } }
+};
+
+// Bitmap helpers
+#define BIT_TEST(map, bit)   ((map)[(bit) / 32] & (1 << ((bit) % 32)))
+#define BIT_SET(map, bit)    ((map)[(bit) / 32] |= (1 << ((bit) % 32)))
+#define BIT_CLEAR(map, bit)  ((map)[(bit) / 32] &= ~(1 << ((bit) % 32)))
+
+// Buddy blocks are indexed by absolute page frame number, so a block of
+// order n is always 2^n frames long and 2^n frames aligned in physical memory
+#define FRAME_PFN(index)     (pmm.base_pfn + (index))
+
+// Mark a block free at an order, keeping the summary bitmaps in step
+static void free_map_set(uint32_t order, uint32_t block) {
+    BIT_SET(pmm.free_map[order], block);
+    BIT_SET(pmm.summary[order], block / 32);
+    pmm.free_blocks[order]++;
+    pmm.free_orders |= 1 << order;
+}
+
+// Take a block off an order's free map
+static void free_map_clear(uint32_t order, uint32_t block) {
+    BIT_CLEAR(pmm.free_map[order], block);
+    if (pmm.free_map[order][block / 32] == 0) {
+        BIT_CLEAR(pmm.summary[order], block / 32);
+    }
+    if (--pmm.free_blocks[order] == 0) {
+        pmm.free_orders &= ~(1 << order);
+    }
+}
+
+// Add a free block, merging with its buddy for as long as the buddy is free
+static void buddy_insert(uint32_t pfn, uint32_t order) {
+    while (order < PMM_MAX_ORDER) {
+        uint32_t buddy = pfn ^ (1 << order);
+        if (!BIT_TEST(pmm.free_map[order], buddy >> order)) {
+            break;
+        }
+        
+        free_map_clear(order, buddy >> order);
+        pfn &= ~(1 << order);
+        order++;
+    }
+    
+    free_map_set(order, pfn >> order);
+}
+
+// Find any free block of exactly this order: the summary says which free
+// map words are non-zero, so this touches two words per summary word skipped
+static uint32_t buddy_find(uint32_t order) {
+    uint32_t* summary = pmm.summary[order];
+    
+    for (uint32_t word = 0; word < pmm.summary_words[order]; word++) {
+        if (summary[word]) {
+            uint32_t map_word = word * 32 + __builtin_ctz(summary[word]);
+            return map_word * 32 + __builtin_ctz(pmm.free_map[order][map_word]);
+        }
+    }
+    
+    return 0; // Caller checked free_orders, so this is unreachable
+}
+
+// Take one frame out of whichever free block holds it, splitting the rest
+static void buddy_remove_frame(uint32_t pfn) {
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        uint32_t head = pfn & ~((1 << order) - 1);
+        if (!BIT_TEST(pmm.free_map[order], head >> order)) {
+            continue;
+        }
+        
+        free_map_clear(order, head >> order);
+        
+        // Keep the half without the frame free at every level down
+        while (order > 0) {
+            order--;
+            uint32_t upper = head + (1 << order);
+            if (pfn >= upper) {
+                free_map_set(order, head >> order);
+                head = upper;
+            } else {
+                free_map_set(order, upper >> order);
+            }
+        }
+        return;
+    }
+}
+
+// Clip a memory map entry to the managed range. Usable regions shrink to
+// whole frames inside them; anything else grows to cover every frame it touches
+static int region_clip(const e820_entry_t* entry, uint32_t* start, uint32_t* end) {
+    uint64_t base = entry->base;
+    uint64_t top = entry->base + entry->length;
+    
+    if (base >= pmm.memory_end || top <= MEMORY_START) {
+        return 0;
+    }
+    if (base < MEMORY_START) {
+        base = MEMORY_START;
+    }
+    if (top > pmm.memory_end) {
+        top = pmm.memory_end;
+    }
+    
+    if (entry->type == MEMORY_REGION_AVAILABLE) {
+        *start = memory_align_up((uint32_t)base, PAGE_SIZE);
+        *end = memory_align_down((uint32_t)top, PAGE_SIZE);
+    } else {
+        *start = memory_align_down((uint32_t)base, PAGE_SIZE);
+        *end = memory_align_up((uint32_t)top, PAGE_SIZE);
+    }
+    
+    return *start < *end;
+}
+
+// Initialize physical memory manager from the BIOS memory map
+void pmm_init(const e820_map_t* map) {
     serial_write_string("Initializing Physical Memory Manager...\n");
+    char buffer[32];
+    
+    if (!map || map->count == 0 || map->count > E820_MAX_ENTRIES) {
+        serial_write_string("PMM: No E820 memory map, assuming 32MB\n");
+        map = &fallback_map;
+    }
+    
+    // Managed memory ends at the top of the highest usable region
+    uint64_t top = 0;
+    for (uint32_t i = 0; i < map->count; i++) {
+        const e820_entry_t* entry = &map->entries[i];
+        
+        serial_write_string("E820: ");
+        itoa((uint32_t)(entry->base >> 10), buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("KB - ");
+        itoa((uint32_t)((entry->base + entry->length) >> 10), buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("KB type ");
+        itoa(entry->type, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("\n");
+        
+        if (entry->type == MEMORY_REGION_AVAILABLE && entry->base + entry->length > top) {
+            top = entry->base + entry->length;
+        }
+    }
+    if (top > MEMORY_LIMIT) {
+        top = MEMORY_LIMIT;
+    }
+    if (top <= MEMORY_START + PAGE_SIZE) {
+        serial_write_string("PMM: Memory map has no RAM above 2MB, assuming 32MB\n");
+        map = &fallback_map;
+        top = MEMORY_START + MEMORY_SIZE;
+    }
+    pmm.memory_end = memory_align_down((uint32_t)top, PAGE_SIZE);
     
     // Calculate number of frames
-    pmm.total_frames = MEMORY_SIZE / PAGE_SIZE;
-    pmm.free_frames = pmm.total_frames;
-    pmm.first_free_frame = 0;
+    pmm.total_frames = (pmm.memory_end - MEMORY_START) / PAGE_SIZE;
+    pmm.free_frames = 0;
+    pmm.base_pfn = MEMORY_START / PAGE_SIZE;
     
     // Calculate bitmap size (1 bit per frame)
     pmm.bitmap_size = (pmm.total_frames + 31) / 32; // Round up to 32-bit words
     
-    // Place bitmap at start of available memory
-    pmm.bitmap = (uint32_t*)MEMORY_START;
+    // Size the bitmap, per-order free maps and their summaries
+    uint32_t end_pfn = pmm.base_pfn + pmm.total_frames;
+    uint32_t metadata_words = pmm.bitmap_size;
+    pmm.free_orders = 0;
+    pmm.zero_pool_hits = 0;
+    pmm.zero_pool_misses = 0;
+    zero_pool_count = 0;
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        pmm.free_map_words[order] = ((end_pfn >> order) + 1) / 32 + 1;
+        pmm.summary_words[order] = (pmm.free_map_words[order] + 31) / 32;
+        pmm.free_blocks[order] = 0;
+        metadata_words += pmm.free_map_words[order] + pmm.summary_words[order];
+    }
+    uint32_t pages_size = pmm.total_frames * sizeof(page_t);
+    uint32_t metadata_size = memory_align_up(pages_size + metadata_words * sizeof(uint32_t), PAGE_SIZE);
+    
+    // Place them at the start of the first usable region big enough
+    uint32_t metadata = 0;
+    for (uint32_t i = 0; i < map->count && !metadata; i++) {
+        uint32_t start, end;
+        if (map->entries[i].type == MEMORY_REGION_AVAILABLE &&
+            region_clip(&map->entries[i], &start, &end) && end - start >= metadata_size) {
+            metadata = start;
+        }
+    }
+    if (!metadata) {
+        serial_write_string("PMM ERROR: No room for frame bitmaps\n");
+        return;
+    }
+    
+    pmm.pages = (page_t*)metadata;
+    memset(pmm.pages, 0, pages_size);
+    
+    pmm.bitmap = (uint32_t*)(metadata + pages_size);
+    uint32_t* next_map = pmm.bitmap + pmm.bitmap_size;
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        pmm.free_map[order] = next_map;
+        next_map += pmm.free_map_words[order];
+        pmm.summary[order] = next_map;
+        next_map += pmm.summary_words[order];
+    }
+    
+    // Every frame starts used (holes stay that way, pinned); no buddy blocks yet
+    memset(pmm.bitmap, 0xFF, pmm.bitmap_size * sizeof(uint32_t));
+    memset(pmm.bitmap + pmm.bitmap_size, 0, (metadata_words - pmm.bitmap_size) * sizeof(uint32_t));
+    
+    // Free the frames of usable regions, then re-reserve anything an
+    // overlapping reserved entry claims
+    for (uint32_t pass = 0; pass < 2; pass++) {
+        for (uint32_t i = 0; i < map->count; i++) {
+            const e820_entry_t* entry = &map->entries[i];
+            uint32_t start, end;
+            if ((entry->type == MEMORY_REGION_AVAILABLE) != (pass == 0) ||
+                !region_clip(entry, &start, &end)) {
+                continue;
+            }
+            
+            for (uint32_t addr = start; addr < end; addr += PAGE_SIZE) {
+                uint32_t index = (addr - MEMORY_START) / PAGE_SIZE;
+                if (pass == 0 && BIT_TEST(pmm.bitmap, index)) {
+                    BIT_CLEAR(pmm.bitmap, index);
+                    pmm.free_frames++;
+                } else if (pass == 1 && !BIT_TEST(pmm.bitmap, index)) {
+                    BIT_SET(pmm.bitmap, index);
+                    pmm.free_frames--;
+                }
+            }
+        }
+    }
+    
+    // Frames no entry covered are holes, pinned like reserved ones
+    for (uint32_t i = 0; i < pmm.total_frames; i++) {
+        if (BIT_TEST(pmm.bitmap, i)) {
+            pmm.pages[i].flags = PAGE_FLAG_PINNED;
+        }
+    }
     
-    // Clear bitmap (all frames free initially)
-    memset(pmm.bitmap, 0, pmm.bitmap_size * sizeof(uint32_t));
+    // Mark frames used by the descriptors and bitmaps themselves
+    for (uint32_t addr = metadata; addr < metadata + metadata_size; addr += PAGE_SIZE) {
+        uint32_t index = (addr - MEMORY_START) / PAGE_SIZE;
+        pmm_mark_frame_used(index);
+        pmm.pages[index].refcount = 1;
+        pmm.pages[index].flags = PAGE_FLAG_KERNEL | PAGE_FLAG_PINNED;
+    }
     
-    // Mark frames used by bitmap itself
-    uint32_t bitmap_frames = (pmm.bitmap_size * sizeof(uint32_t) + PAGE_SIZE - 1) / PAGE_SIZE;
-    for (uint32_t i = 0; i < bitmap_frames; i++) {
-        pmm_mark_frame_used(i);
+    // Build the buddy free lists; neighbours merge as they are added
+    for (uint32_t i = 0; i < pmm.total_frames; i++) {
+        if (!BIT_TEST(pmm.bitmap, i)) {
+            buddy_insert(FRAME_PFN(i), 0);
+        }
     }
     
     serial_write_string("PMM: Initialized with ");
-    char buffer[32];
-    itoa(pmm.total_frames, buffer, 10);
+    itoa(pmm.free_frames, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" free frames (");
+    itoa(pmm.free_frames / 256, buffer, 10);
     serial_write_string(buffer);
-    serial_write_string(" frames (");
-    itoa(pmm.total_frames * PAGE_SIZE / 1024 / 1024, buffer, 10);
+    serial_write_string("MB) below ");
+    itoa(pmm.memory_end / 1024 / 1024, buffer, 10);
     serial_write_string(buffer);
-    serial_write_string("MB)\n");
+    serial_write_string("MB\n");
+}
+
+// Allocate 2^order frames; caller has interrupts off
+static uint32_t buddy_alloc(uint32_t order) {
+    if (order > PMM_MAX_ORDER) {
+        return 0;
+    }
+    
+    // Smallest order with a free block, straight from the order mask;
+    // under pressure the zeroed pool gives its frames back first
+    uint32_t candidates = pmm.free_orders >> order;
+    if (!candidates && zero_pool_drain()) {
+        candidates = pmm.free_orders >> order;
+    }
+    if (!candidates) {
+        return 0; // Out of memory (or too fragmented)
+    }
+    uint32_t found = order + __builtin_ctz(candidates);
+    
+    uint32_t pfn = buddy_find(found) << found;
+    free_map_clear(found, pfn >> found);
+    
+    // Split down to the requested order, freeing the upper halves
+    while (found > order) {
+        found--;
+        free_map_set(found, (pfn + (1 << found)) >> found);
+    }
+    
+    // Mark the frames used
+    uint32_t index = pfn - pmm.base_pfn;
+    for (uint32_t i = 0; i < (1u << order); i++) {
+        BIT_SET(pmm.bitmap, index + i);
+    }
+    pmm.free_frames -= 1 << order;
+    
+    // The head descriptor carries the block's single reference and order
+    page_t* page = &pmm.pages[index];
+    page->refcount = 1;
+    page->flags = 0;
+    page->lru_next = 0;
+    page->lru_prev = 0;
+    page->private = order;
+    
+    // Return physical address
+    return pfn * PAGE_SIZE;
+}
+
+// Free a block; caller has interrupts off
+static void buddy_free(uint32_t frame_addr, uint32_t order) {
+    if (frame_addr < MEMORY_START || order > PMM_MAX_ORDER) {
+        return; // Invalid address
+    }
+    
+    if (frame_addr & ((PAGE_SIZE << order) - 1)) {
+        serial_write_string("PMM ERROR: Misaligned block in free\n");
+        return;
+    }
+    
+    uint32_t frame_index = (frame_addr - MEMORY_START) / PAGE_SIZE;
+    
+    if (frame_index + (1 << order) > pmm.total_frames) {
+        return; // Invalid frame
+    }
+    
+    // Every frame must still be allocated; this also catches double frees
+    for (uint32_t i = 0; i < (1u << order); i++) {
+        if (!BIT_TEST(pmm.bitmap, frame_index + i)) {
+            return;
+        }
+    }
+    
+    for (uint32_t i = 0; i < (1u << order); i++) {
+        BIT_CLEAR(pmm.bitmap, frame_index + i);
+    }
+    pmm.free_frames += 1 << order;
+    pmm.pages[frame_index].refcount = 0;
+    pmm.pages[frame_index].flags = 0;
+    
+    buddy_insert(FRAME_PFN(frame_index), order);
+}
+
+// Allocate 2^order physically contiguous frames, aligned to their size.
+// Interrupts stay off so a preempting process never sees a half-split block
+uint32_t pmm_alloc_frames(uint32_t order) {
+    uint32_t flags = irq_save();
+    uint32_t frame = buddy_alloc(order);
+    irq_restore(flags);
+    return frame;
+}
+
+// Free a block returned by pmm_alloc_frames with the same order
+void pmm_free_frames(uint32_t frame_addr, uint32_t order) {
+    uint32_t flags = irq_save();
+    buddy_free(frame_addr, order);
+    irq_restore(flags);
 }
 
 // Allocate a physical frame
 uint32_t pmm_alloc_frame(void) {
-    if (pmm.free_frames == 0) {
-        return 0; // Out of memory
+    return pmm_alloc_frames(0);
+}
+
+// Free a physical frame
+void pmm_free_frame(uint32_t frame_addr) {
+    pmm_free_frames(frame_addr, 0);
+}
+
+// Allocate a frame whose contents are zero, from the pool when possible
+uint32_t pmm_alloc_zeroed_frame(void) {
+    uint32_t flags = irq_save();
+    uint32_t frame = zero_pool_count ? zero_pool[--zero_pool_count] : 0;
+    if (frame) {
+        pmm.zero_pool_hits++;
+    } else {
+        pmm.zero_pool_misses++;
     }
+    irq_restore(flags);
     
-    // Start searching from first_free_frame for efficiency
-    for (uint32_t i = pmm.first_free_frame; i < pmm.total_frames; i++) {
-        uint32_t word_index = i / 32;
-        uint32_t bit_index = i % 32;
-        
-        if (!(pmm.bitmap[word_index] & (1 << bit_index))) {
-            // Found free frame
-            pmm.bitmap[word_index] |= (1 << bit_index);
-            pmm.free_frames--;
-            
-            // Update first_free_frame hint
-            if (i == pmm.first_free_frame) {
-                pmm.first_free_frame++;
-            }
-            
-            // Return physical address
-            return MEMORY_START + (i * PAGE_SIZE);
-        }
+    if (frame) {
+        return frame;
+    }
+    
+    // Pool is empty: zero synchronously
+    frame = pmm_alloc_frame();
+    if (frame) {
+        memset(PHYS_TO_VIRT(frame), 0, PAGE_SIZE);
     }
+    return frame;
+}
+
+// Zero up to max_frames frames into the pool; returns how many were added.
+// Called from the idle loop so the memsets happen off the allocation path
+uint32_t pmm_zero_pool_refill(uint32_t max_frames) {
+    uint32_t added = 0;
     
-    // Fallback: search from beginning
-    for (uint32_t i = 0; i < pmm.first_free_frame; i++) {
-        uint32_t word_index = i / 32;
-        uint32_t bit_index = i % 32;
+    while (added < max_frames && zero_pool_count < PMM_ZERO_POOL_SIZE) {
+        // Leave the last free frames for real allocations
+        if (pmm.free_frames <= PMM_ZERO_POOL_SIZE) {
+            break;
+        }
         
-        if (!(pmm.bitmap[word_index] & (1 << bit_index))) {
-            // Found free frame
-            pmm.bitmap[word_index] |= (1 << bit_index);
-            pmm.free_frames--;
-            
-            // Return physical address
-            return MEMORY_START + (i * PAGE_SIZE);
+        uint32_t frame = pmm_alloc_frame();
+        if (!frame) {
+            break;
+        }
+        memset(PHYS_TO_VIRT(frame), 0, PAGE_SIZE);
+        
+        uint32_t flags = irq_save();
+        if (zero_pool_count < PMM_ZERO_POOL_SIZE) {
+            zero_pool[zero_pool_count++] = frame;
+            frame = 0;
+        }
+        irq_restore(flags);
+        
+        if (frame) {
+            pmm_free_frame(frame); // Filled by someone else meanwhile
+            break;
         }
+        added++;
     }
     
-    return 0; // Out of memory
+    return added;
 }
 
-// Free a physical frame
-void pmm_free_frame(uint32_t frame_addr) {
-    if (frame_addr < MEMORY_START) {
-        return; // Invalid address
+// Hand every pooled frame back to the buddy allocator
+static int zero_pool_drain(void) {
+    int drained = 0;
+    
+    while (zero_pool_count > 0) {
+        pmm_free_frame(zero_pool[--zero_pool_count]);
+        drained = 1;
     }
     
-    uint32_t frame_index = (frame_addr - MEMORY_START) / PAGE_SIZE;
+    return drained;
+}
+
+// Descriptor for a managed frame, or NULL if the address is outside the PMM
+page_t* pmm_get_page(uint32_t frame_addr) {
+    if (frame_addr < MEMORY_START || frame_addr >= pmm.memory_end) {
+        return NULL;
+    }
     
-    if (frame_index >= pmm.total_frames) {
-        return; // Invalid frame
+    return &pmm.pages[(frame_addr - MEMORY_START) / PAGE_SIZE];
+}
+
+// Take another reference to an allocated frame (e.g. for a shared mapping)
+void pmm_frame_get(uint32_t frame_addr) {
+    page_t* page = pmm_get_page(frame_addr);
+    uint32_t flags = irq_save();
+    if (page && page->refcount) {
+        page->refcount++;
+    }
+    irq_restore(flags);
+}
+
+// Drop a reference; the block goes back to the buddy allocator with the last one
+void pmm_frame_put(uint32_t frame_addr) {
+    page_t* page = pmm_get_page(frame_addr);
+    if (!page) {
+        return; // Not managed memory (kernel image, devices)
     }
     
-    uint32_t word_index = frame_index / 32;
-    uint32_t bit_index = frame_index % 32;
+    uint32_t flags = irq_save();
+    if (page->refcount == 0) {
+        serial_write_string("PMM ERROR: Reference count underflow\n");
+    } else if (--page->refcount == 0) {
+        buddy_free(memory_align_down(frame_addr, PAGE_SIZE), page->private);
+    }
+    irq_restore(flags);
+}
+
+// Drop one reference on each frame, then free the frames that reached
+// zero as the largest aligned blocks their physically contiguous runs
+// form, so a teardown coalesces once per block instead of once per frame.
+// The array is reused as scratch space
+void pmm_frame_put_batch(uint32_t* frames, uint32_t count) {
+    uint32_t released = 0;
     
-    if (pmm.bitmap[word_index] & (1 << bit_index)) {
-        // Frame was allocated, now free it
-        pmm.bitmap[word_index] &= ~(1 << bit_index);
-        pmm.free_frames++;
+    // Reference counts only; the frees below each take interrupts off again
+    uint32_t flags = irq_save();
+    for (uint32_t i = 0; i < count; i++) {
+        page_t* page = pmm_get_page(frames[i]);
+        if (!page) {
+            continue; // Not managed memory (kernel image, devices)
+        }
         
-        // Update first_free_frame hint if this frame is earlier
-        if (frame_index < pmm.first_free_frame) {
-            pmm.first_free_frame = frame_index;
+        if (page->refcount == 0) {
+            serial_write_string("PMM ERROR: Reference count underflow\n");
+        } else if (--page->refcount == 0) {
+            uint32_t frame_addr = memory_align_down(frames[i], PAGE_SIZE);
+            if (page->private) {
+                buddy_free(frame_addr, page->private); // Already a block
+            } else {
+                page->flags = 0;
+                frames[released++] = frame_addr;
+            }
+        }
+    }
+    irq_restore(flags);
+    
+    // Sort so neighbouring frames sit next to each other
+    for (uint32_t i = 1; i < released; i++) {
+        uint32_t frame_addr = frames[i];
+        uint32_t j = i;
+        while (j > 0 && frames[j - 1] > frame_addr) {
+            frames[j] = frames[j - 1];
+            j--;
+        }
+        frames[j] = frame_addr;
+    }
+    
+    uint32_t i = 0;
+    while (i < released) {
+        uint32_t run = 1;
+        while (i + run < released && frames[i + run] == frames[i] + run * PAGE_SIZE) {
+            run++;
+        }
+        
+        // Carve the run into blocks aligned to their own size
+        uint32_t pfn = frames[i] / PAGE_SIZE;
+        i += run;
+        while (run) {
+            uint32_t order = pfn ? __builtin_ctz(pfn) : PMM_MAX_ORDER;
+            if (order > PMM_MAX_ORDER) {
+                order = PMM_MAX_ORDER;
+            }
+            while ((1u << order) > run) {
+                order--;
+            }
+            
+            flags = irq_save();
+            buddy_free(pfn * PAGE_SIZE, order);
+            irq_restore(flags);
+            
+            pfn += 1 << order;
+            run -= 1 << order;
         }
     }
 }
@@ -121,13 +573,11 @@ void pmm_mark_frame_used(uint32_t frame_index) {
         return;
     }
     
-    uint32_t word_index = frame_index / 32;
-    uint32_t bit_index = frame_index % 32;
-    
-    if (!(pmm.bitmap[word_index] & (1 << bit_index))) {
+    if (!BIT_TEST(pmm.bitmap, frame_index)) {
         // Frame was free, now mark as used
-        pmm.bitmap[word_index] |= (1 << bit_index);
+        BIT_SET(pmm.bitmap, frame_index);
         pmm.free_frames--;
+        buddy_remove_frame(FRAME_PFN(frame_index));
     }
 }
 
@@ -136,6 +586,158 @@ uint32_t pmm_get_free_frames(void) {
     return pmm.free_frames;
 }
 
+// Free frames plus those parked in the zeroed pool
+uint32_t pmm_get_available_frames(void) {
+    return pmm.free_frames + zero_pool_count;
+}
+
+// Get end of managed physical memory
+uint32_t pmm_get_memory_end(void) {
+    return pmm.memory_end;
+}
+
+// Microbenchmark: allocate every free frame one at a time, then free them all
+void pmm_benchmark(void) {
+    char buffer[32];
+    uint32_t capacity = pmm.free_frames;
+    
+    // The frame list lives on the heap so the frames themselves stay untouched
+    uint32_t* frames = (uint32_t*)heap_malloc(capacity * sizeof(uint32_t));
+    if (!frames) {
+        serial_write_string("PMM ERROR: No memory for benchmark\n");
+        return;
+    }
+    
+    uint32_t count = 0;
+    uint64_t start = rdtsc();
+    while (count < capacity) {
+        uint32_t frame = pmm_alloc_frame();
+        if (!frame) {
+            break;
+        }
+        frames[count++] = frame;
+    }
+    uint32_t alloc_cycles = (uint32_t)(rdtsc() - start);
+    
+    start = rdtsc();
+    for (uint32_t i = 0; i < count; i++) {
+        pmm_free_frame(frames[i]);
+    }
+    uint32_t free_cycles = (uint32_t)(rdtsc() - start);
+    
+    heap_free(frames);
+    
+    serial_write_string("\n=== PMM BENCHMARK ===\n");
+    serial_write_string("Frames: ");
+    itoa(count, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("\n");
+    
+    if (count) {
+        serial_write_string("Alloc: ");
+        itoa(alloc_cycles / count, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string(" cycles/frame\n");
+        
+        serial_write_string("Free: ");
+        itoa(free_cycles / count, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string(" cycles/frame\n");
+    }
+    
+    serial_write_string("=====================\n");
+}
+
+// Print free frames and the free buddy blocks at each order
+void pmm_print_stats(void) {
+    char buffer[32];
+    
+    serial_write_string("\n=== PHYSICAL MEMORY ===\n");
+    
+    serial_write_string("Free frames: ");
+    itoa(pmm.free_frames, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" of ");
+    itoa(pmm.total_frames, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("\n");
+    
+    // Owners of allocated frames, from the descriptor array
+    uint32_t kernel = 0, user = 0, cache = 0, pinned = 0, shared = 0;
+    for (uint32_t i = 0; i < pmm.total_frames; i++) {
+        page_t* page = &pmm.pages[i];
+        if (page->flags & PAGE_FLAG_KERNEL) {
+            kernel++;
+        }
+        if (page->flags & PAGE_FLAG_USER) {
+            user++;
+        }
+        if (page->flags & PAGE_FLAG_CACHE) {
+            cache++;
+        }
+        if (page->flags & PAGE_FLAG_PINNED) {
+            pinned++;
+        }
+        if (page->refcount > 1) {
+            shared++;
+        }
+    }
+    
+    serial_write_string("Frames by owner: kernel ");
+    itoa(kernel, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(", user ");
+    itoa(user, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(", cache ");
+    itoa(cache, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(", pinned ");
+    itoa(pinned, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(", shared ");
+    itoa(shared, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("\n");
+    
+    serial_write_string("Zeroed pool: ");
+    itoa(zero_pool_count, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" frames, ");
+    itoa(pmm.zero_pool_hits, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" hits, ");
+    itoa(pmm.zero_pool_misses, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" misses\n");
+    
+    serial_write_string("Free blocks by order:\n");
+    int largest = -1;
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        serial_write_string("  order ");
+        itoa(order, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string(" (");
+        itoa((PAGE_SIZE << order) / 1024, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("KB): ");
+        itoa(pmm.free_blocks[order], buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("\n");
+        
+        if (pmm.free_blocks[order]) {
+            largest = order;
+        }
+    }
+    
+    serial_write_string("Largest contiguous run: ");
+    itoa(largest < 0 ? 0 : (PAGE_SIZE << largest) / 1024, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("KB\n");
+    
+    serial_write_string("=======================\n");
+}
+
 // Simple itoa implementation for debugging
 void itoa(int value, char* str, int base) {
     char* ptr = str;
@@ -3,6 +3,9 @@
 #include "../include/libc/string.h"
 #include "../include/serial.h"
 #include "../include/utils.h"
+#include "../include/cpu.h"
+#include "../include/timer.h"
+#include "../include/sync.h"
 
 // Global process table
 static process_t process_table[MAX_PROCESSES];
@@ -48,16 +51,49 @@ uint32_t process_get_next_pid(void) {
     return pid;
 }
 
-// Create a new process
-process_t* process_create(const char* name, void* entry_point, uint32_t priority) {
-    // Find free slot in process table
-    process_t* process = NULL;
+// Find a free slot in the process table
+static process_t* process_alloc_slot(void) {
     for (int i = 1; i < MAX_PROCESSES; i++) {
         if (process_table[i].state == 0) { // Unused slot
-            process = &process_table[i];
-            break;
+            return &process_table[i];
         }
     }
+    return NULL;
+}
+
+// First code every new process runs, entered by the context switch
+// returning into it; calls the entry point and exits when it returns
+static void process_start(void) {
+    scheduler_finish_switch();
+    
+    // The switch happened with interrupts off
+    asm volatile ("sti");
+    
+    void (*entry)(void) = (void (*)(void))current_process->eip;
+    entry();
+    
+    process_exit(0);
+}
+
+// Lay out a kernel stack so the first switch to it "returns" into
+// process_start: callee-saved registers, then the return address
+static void process_setup_stack(process_t* process) {
+    uint32_t* stack = (uint32_t*)PHYS_TO_VIRT(process->kernel_stack +
+                                              (PAGE_SIZE << PROCESS_KERNEL_STACK_ORDER));
+    
+    *--stack = (uint32_t)process_start; // Return address
+    *--stack = 0;                       // ebp
+    *--stack = 0;                       // ebx
+    *--stack = 0;                       // esi
+    *--stack = 0;                       // edi
+    
+    process->kernel_esp = (uint32_t)stack;
+}
+
+// Claim a slot and give it a kernel stack; no address space yet
+static process_t* process_alloc(const char* name, void* entry_point, uint32_t priority) {
+    // Find free slot in process table
+    process_t* process = process_alloc_slot();
     
     if (!process) {
         serial_write_string("ERROR: No free process slots\n");
@@ -75,41 +111,20 @@ process_t* process_create(const char* name, void* entry_point, uint32_t priority
     process->time_slice = (priority == PROCESS_PRIORITY_HIGH) ? 50 : 
                          (priority == PROCESS_PRIORITY_NORMAL) ? 100 : 200;
     
-    // Set up memory space
-    process->page_directory = vmm_create_page_directory();
-    if (!process->page_directory) {
-        serial_write_string("ERROR: Failed to create page directory\n");
-        return NULL;
-    }
-    
     // Allocate kernel stack
-    process->kernel_stack = pmm_alloc_frame();
+    process->kernel_stack = pmm_alloc_frames(PROCESS_KERNEL_STACK_ORDER);
     if (!process->kernel_stack) {
         serial_write_string("ERROR: Failed to allocate kernel stack\n");
+        memset(process, 0, sizeof(process_t));
         return NULL;
     }
     
-    // Allocate user stack
-    process->user_stack = pmm_alloc_frame();
-    if (!process->user_stack) {
-        serial_write_string("ERROR: Failed to allocate user stack\n");
-        pmm_free_frame(process->kernel_stack);
-        return NULL;
-    }
-    
-    // Map user stack in virtual memory
-    vmm_map_page(process->page_directory, USER_VIRTUAL_BASE + 0x10000, 
-                 process->user_stack, PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER);
+    pmm_get_page(process->kernel_stack)->flags = PAGE_FLAG_KERNEL;
     
     // Set up initial context
     process->eip = (uint32_t)entry_point;
-    process->esp = USER_VIRTUAL_BASE + 0x10000 + PROCESS_STACK_SIZE - 4;
-    process->ebp = process->esp;
     process->eflags = 0x202; // Enable interrupts
-    
-    // Set up heap
-    process->heap_start = USER_VIRTUAL_BASE + 0x20000;
-    process->heap_end = USER_VIRTUAL_BASE + 0x100000; // 1MB heap
+    process_setup_stack(process);
     
     // Copy current directory from parent
     if (current_process) {
@@ -120,36 +135,146 @@ process_t* process_create(const char* name, void* entry_point, uint32_t priority
     
     process->creation_time = timer_ticks;
     
+    return process;
+}
+
+// Print a creation message
+static void process_announce(process_t* process) {
     serial_write_string("Created process: ");
-    serial_write_string(name);
+    serial_write_string(process->name);
     serial_write_string(" (PID ");
     char buffer[16];
     itoa(process->pid, buffer, 10);
     serial_write_string(buffer);
     serial_write_string(")\n");
+}
+
+// Create a new process
+process_t* process_create(const char* name, void* entry_point, uint32_t priority) {
+    process_t* process = process_alloc(name, entry_point, priority);
+    if (!process) {
+        return NULL;
+    }
+    
+    // Set up memory space
+    process->page_directory = vmm_create_page_directory();
+    if (!process->page_directory) {
+        serial_write_string("ERROR: Failed to create page directory\n");
+        pmm_free_frames(process->kernel_stack, PROCESS_KERNEL_STACK_ORDER);
+        memset(process, 0, sizeof(process_t));
+        return NULL;
+    }
+    
+    // Stack and heap are regions only; the page-fault handler maps zeroed
+    // frames on first touch, so untouched pages cost nothing
+    process->heap_start = PROCESS_HEAP_BASE;
+    process->heap_end = PROCESS_HEAP_BASE + PROCESS_HEAP_SIZE;
+    process->mmap_next = PROCESS_MMAP_BASE;
+    vma_add(process, PROCESS_STACK_BASE, PROCESS_STACK_BASE + PROCESS_STACK_SIZE,
+            PAGE_WRITABLE, VMA_STACK);
+    vma_add(process, process->heap_start, process->heap_end, PAGE_WRITABLE, VMA_HEAP);
     
+    // User-side stack pointer for when the process enters its own stack
+    process->esp = PROCESS_STACK_BASE + PROCESS_STACK_SIZE - 4;
+    process->ebp = process->esp;
+    
+    process_announce(process);
     return process;
 }
 
-// Destroy a process
+// Create a kernel thread: runs on its kernel stack in the kernel directory
+process_t* process_create_thread(const char* name, void* entry_point, uint32_t priority) {
+    process_t* process = process_alloc(name, entry_point, priority);
+    if (process) {
+        process_announce(process);
+    }
+    return process;
+}
+
+// Spawn a new process with a copy-on-write copy of the parent's address
+// space. This is not fork: processes are kernel threads with no user-mode
+// frame to resume, so the child starts fresh at the parent's entry point
+// and sees the parent's memory as it was at the time of the call
+process_t* process_spawn_cow(process_t* parent) {
+    if (!parent || !parent->page_directory) {
+        return NULL; // The kernel process has no user address space
+    }
+    
+    process_t* child = process_alloc_slot();
+    if (!child) {
+        serial_write_string("ERROR: No free process slots\n");
+        return NULL;
+    }
+    
+    // Regions, priority and working directory carry over unchanged
+    memcpy(child, parent, sizeof(process_t));
+    child->pid = process_get_next_pid();
+    child->parent_pid = parent->pid;
+    child->state = PROCESS_STATE_READY;
+    child->time_used = 0;
+    child->total_time = 0;
+    child->page_faults = 0;
+    child->next = NULL;
+    child->prev = NULL;
+    child->run_queue = NULL;
+    child->wait_queue = NULL;
+    child->creation_time = timer_ticks;
+    
+    child->kernel_stack = pmm_alloc_frames(PROCESS_KERNEL_STACK_ORDER);
+    if (!child->kernel_stack) {
+        serial_write_string("ERROR: Failed to allocate kernel stack\n");
+        memset(child, 0, sizeof(process_t));
+        return NULL;
+    }
+    pmm_get_page(child->kernel_stack)->flags = PAGE_FLAG_KERNEL;
+    
+    // Processes are kernel threads with no user-mode frame to copy, so the
+    // child starts fresh at the parent's entry point in the shared space
+    process_setup_stack(child);
+    
+    child->page_directory = vmm_clone_directory(parent->page_directory);
+    if (!child->page_directory) {
+        serial_write_string("ERROR: Failed to clone address space\n");
+        pmm_free_frames(child->kernel_stack, PROCESS_KERNEL_STACK_ORDER);
+        memset(child, 0, sizeof(process_t));
+        return NULL;
+    }
+    
+    serial_write_string("Spawned COW copy: ");
+    serial_write_string(child->name);
+    serial_write_string(" (PID ");
+    char buffer[16];
+    itoa(child->pid, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(")\n");
+    
+    return child;
+}
+
+// Destroy a process; a process that exits is destroyed by the scheduler
+// once it is off its own kernel stack
 void process_destroy(process_t* process) {
-    if (!process || process->pid == 0) {
-        return; // Can't destroy kernel process
+    if (!process || process->pid == 0 || process == current_process) {
+        return; // Can't destroy kernel process or the stack we run on
     }
     
+    scheduler_remove_process(process);
+    timer_cancel_sleep(process);
+    wait_queue_cancel(process);
+    
     serial_write_string("Destroying process: ");
     serial_write_string(process->name);
     serial_write_string("\n");
     
     // Free memory
     if (process->kernel_stack) {
-        pmm_free_frame(process->kernel_stack);
-    }
-    if (process->user_stack) {
-        pmm_free_frame(process->user_stack);
+        pmm_free_frames(process->kernel_stack, PROCESS_KERNEL_STACK_ORDER);
     }
     
-    // TODO: Free all pages in process page directory
+    // Every faulted-in frame, page table and the directory itself
+    vmm_destroy_directory(process->page_directory);
+    process->page_directory = NULL;
+    process->vma_count = 0;
     
     // Mark as terminated
     process->state = PROCESS_STATE_TERMINATED;
@@ -179,6 +304,8 @@ void process_exit(int exit_code) {
         return; // Can't exit kernel process
     }
     
+    // Interrupts stay off until the switch away; the scheduler reaps us
+    asm volatile ("cli");
     current_process->exit_code = exit_code;
     current_process->state = PROCESS_STATE_TERMINATED;
     
@@ -190,7 +317,7 @@ void process_exit(int exit_code) {
     serial_write_string(buffer);
     serial_write_string("\n");
     
-    // Schedule next process
+    // Schedule next process; never returns
     scheduler_schedule();
 }
 
@@ -227,4 +354,72 @@ void test_process2(void) {
         // Simple delay
         for (volatile int i = 0; i < 1000000; i++);
     }
-} 
\ No newline at end of file
+} 
+
+// Run code inside a process's address space; faults resolve against it
+static void process_touch_heap(process_t* process, uint32_t pages) {
+    process_t* saved = current_process;
+    
+    current_process = process;
+    vmm_switch_page_directory(process->page_directory);
+    for (uint32_t i = 0; i < pages; i++) {
+        *(volatile uint32_t*)(process->heap_start + i * PAGE_SIZE) = i;
+    }
+    vmm_switch_page_directory(vmm_get_kernel_directory());
+    current_process = saved;
+}
+
+// Spawn, fault in, COW-copy and destroy processes repeatedly; the available
+// frame count must come back to where it started
+void process_stress_test(uint32_t rounds) {
+    char buffer[16];
+    uint32_t before = pmm_get_available_frames();
+    uint32_t low = before;
+    uint32_t completed = 0;
+    
+    // Keep the timer from scheduling while current_process is borrowed
+    uint32_t flags = irq_save();
+    
+    for (uint32_t round = 0; round < rounds; round++) {
+        process_t* parent = process_create("stress", test_process1, PROCESS_PRIORITY_LOW);
+        if (!parent) {
+            break;
+        }
+        
+        process_touch_heap(parent, 8);
+        
+        // The child shares those pages and copies one on write
+        process_t* child = process_spawn_cow(parent);
+        if (child) {
+            process_touch_heap(child, 1);
+        }
+        
+        uint32_t available = pmm_get_available_frames();
+        if (available < low) {
+            low = available;
+        }
+        
+        process_destroy(child);
+        process_destroy(parent);
+        completed++;
+    }
+    
+    irq_restore(flags);
+    uint32_t after = pmm_get_available_frames();
+    
+    serial_write_string("\n=== SPAWN/EXIT STRESS ===\n");
+    serial_write_string("Rounds: ");
+    itoa(completed, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("\nAvailable frames before: ");
+    itoa(before, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(", lowest: ");
+    itoa(low, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(", after: ");
+    itoa(after, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(after == before ? "\nNo frames leaked\n" : "\nPMM ERROR: Frames leaked\n");
+    serial_write_string("=========================\n");
+}
\ No newline at end of file
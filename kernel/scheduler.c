@@ -3,12 +3,25 @@
 #include "../include/libc/string.h"
 #include "../include/serial.h"
 #include "../include/utils.h"
+#include "../include/cpu.h"
+#include "../include/timer.h"
 
-// Scheduler state
-static task_queue_t ready_queue;
+// Scheduler state: one FIFO per priority level, and a bitmap with bit
+// N set while run_queues[N] is non-empty
+static task_queue_t run_queues[SCHED_LEVELS];
+static uint32_t ready_bitmap = 0;
+static uint32_t ready_count = 0;
 static scheduler_stats_t stats;
 static int scheduler_enabled = 0;
 
+// Runs when the ready queue is empty; never queued itself
+static process_t* idle_process = NULL;
+
+// Exited process waiting to be freed once we are off its stack
+static process_t* zombie_process = NULL;
+
+static void idle_thread(void);
+
 // External references
 extern process_t* current_process;
 extern uint32_t timer_ticks;
@@ -17,127 +30,165 @@ extern uint32_t timer_ticks;
 void scheduler_init(void) {
     serial_write_string("Initializing scheduler...\n");
     
-    // Initialize ready queue
-    ready_queue.head = NULL;
-    ready_queue.tail = NULL;
-    ready_queue.count = 0;
+    // Initialize run queues
+    memset(run_queues, 0, sizeof(run_queues));
+    ready_bitmap = 0;
+    ready_count = 0;
     
     // Initialize statistics
     memset(&stats, 0, sizeof(scheduler_stats_t));
     
     scheduler_enabled = 1;
     
+    idle_process = process_create_thread("idle", idle_thread, PROCESS_PRIORITY_LOW);
+    
     serial_write_string("Scheduler initialized\n");
 }
 
-// Add process to ready queue
-void scheduler_add_process(process_t* process) {
-    if (!process || !scheduler_enabled) {
-        return;
-    }
+// Append a process to the tail of a level; caller holds interrupts off
+static void run_queue_push(process_t* process, uint32_t level) {
+    task_queue_t* queue = &run_queues[level];
     
-    process->state = PROCESS_STATE_READY;
     process->next = NULL;
+    process->prev = queue->tail;
     
-    if (ready_queue.tail) {
-        ready_queue.tail->next = process;
-        ready_queue.tail = process;
+    if (queue->tail) {
+        queue->tail->next = process;
     } else {
-        ready_queue.head = ready_queue.tail = process;
+        queue->head = process;
     }
+    queue->tail = process;
     
-    ready_queue.count++;
-    stats.total_processes++;
+    queue->count++;
+    process->run_queue = queue;
+    ready_bitmap |= (1 << level);
+    ready_count++;
+}
+
+// Unlink a process from whichever level holds it; caller holds interrupts off
+static void run_queue_unlink(process_t* process) {
+    task_queue_t* queue = process->run_queue;
     
-    serial_write_string("Added process to ready queue: ");
-    serial_write_string(process->name);
-    serial_write_string("\n");
+    if (process->prev) {
+        process->prev->next = process->next;
+    } else {
+        queue->head = process->next;
+    }
+    
+    if (process->next) {
+        process->next->prev = process->prev;
+    } else {
+        queue->tail = process->prev;
+    }
+    
+    queue->count--;
+    if (queue->count == 0) {
+        ready_bitmap &= ~(1 << (queue - run_queues));
+    }
+    ready_count--;
+    
+    process->next = NULL;
+    process->prev = NULL;
+    process->run_queue = NULL;
+}
+
+// Queue a process at its own priority level
+static void scheduler_enqueue(process_t* process) {
+    process->state = PROCESS_STATE_READY;
+    process->ready_since = timer_ticks;
+    run_queue_push(process, SCHED_LEVEL(process->priority));
+}
+
+// Add process to ready queue
+void scheduler_add_process(process_t* process) {
+    if (!process || !scheduler_enabled || process->run_queue) {
+        return;
+    }
+    
+    uint32_t flags = irq_save();
+    scheduler_enqueue(process);
+    stats.total_processes++;
+    irq_restore(flags);
 }
 
 // Remove process from ready queue
 void scheduler_remove_process(process_t* process) {
-    if (!process || !scheduler_enabled || ready_queue.count == 0) {
+    if (!process || !scheduler_enabled || !process->run_queue) {
         return;
     }
     
-    process_t* current = ready_queue.head;
-    process_t* previous = NULL;
-    
-    // Find and remove the process
-    while (current) {
-        if (current == process) {
-            if (previous) {
-                previous->next = current->next;
-            } else {
-                ready_queue.head = current->next;
-            }
-            
-            if (current == ready_queue.tail) {
-                ready_queue.tail = previous;
-            }
-            
-            ready_queue.count--;
-            current->next = NULL;
-            break;
-        }
-        
-        previous = current;
-        current = current->next;
-    }
+    uint32_t flags = irq_save();
+    run_queue_unlink(process);
+    irq_restore(flags);
 }
 
-// Get next process from ready queue (round-robin with priority)
+// Take the head of the highest non-empty level: one bit scan and a dequeue
 static process_t* get_next_process(void) {
-    if (ready_queue.count == 0) {
+    if (!ready_bitmap) {
         return NULL;
     }
     
-    // Simple round-robin for now
-    // TODO: Implement priority-based scheduling
-    process_t* next_process = ready_queue.head;
+    uint32_t level = __builtin_ctz(ready_bitmap);
+    process_t* next_process = run_queues[level].head;
+    run_queue_unlink(next_process);
+    next_process->sched_level = level;
     
-    if (next_process) {
-        ready_queue.head = next_process->next;
-        if (ready_queue.head == NULL) {
-            ready_queue.tail = NULL;
+    return next_process;
+}
+
+// Lift the longest waiter of each lower level one level up once it has
+// waited SCHED_AGING_TICKS, so a busy high level cannot starve it. Queue
+// heads are the oldest entries, so checking them alone is enough
+static void scheduler_age(void) {
+    for (uint32_t level = 1; level < SCHED_LEVELS; level++) {
+        process_t* oldest = run_queues[level].head;
+        if (oldest && timer_ticks - oldest->ready_since >= SCHED_AGING_TICKS) {
+            run_queue_unlink(oldest);
+            oldest->ready_since = timer_ticks;
+            run_queue_push(oldest, level - 1);
+            stats.promotions++;
         }
-        ready_queue.count--;
-        next_process->next = NULL;
     }
-    
-    return next_process;
 }
 
-// Schedule next process
+// Schedule next process; called with interrupts in any state
 void scheduler_schedule(void) {
     if (!scheduler_enabled) {
         return;
     }
     
+    uint32_t flags = irq_save();
+    
+    process_t* previous_process = current_process;
+    
+    // A preempted process goes to the back of its level; it runs again
+    // straight away if nothing of equal or higher priority is waiting
+    if (previous_process->state == PROCESS_STATE_RUNNING && previous_process != idle_process) {
+        scheduler_enqueue(previous_process);
+    }
+    
+    // Nothing runnable: fall back to the idle thread
     process_t* next_process = get_next_process();
+    if (!next_process) {
+        next_process = idle_process;
+    }
     
     if (!next_process) {
-        // No processes to run, continue with current or idle
-        if (current_process && current_process->state == PROCESS_STATE_RUNNING) {
-            return;
-        }
-        
-        // Enter idle state
-        stats.idle_time++;
+        irq_restore(flags); // Idle thread not created yet
         return;
     }
     
-    process_t* previous_process = current_process;
+    if (next_process == previous_process) {
+        previous_process->state = PROCESS_STATE_RUNNING;
+        previous_process->time_used = 0;
+        irq_restore(flags);
+        return;
+    }
     
-    // Save current process context if it's still running
-    if (previous_process && previous_process->state == PROCESS_STATE_RUNNING) {
-        save_context(previous_process);
+    if (previous_process == idle_process) {
         previous_process->state = PROCESS_STATE_READY;
-        
-        // Add back to ready queue if not terminated
-        if (previous_process->state != PROCESS_STATE_TERMINATED) {
-            scheduler_add_process(previous_process);
-        }
+    } else if (previous_process->state == PROCESS_STATE_TERMINATED) {
+        zombie_process = previous_process;
     }
     
     // Switch to next process
@@ -147,19 +198,13 @@ void scheduler_schedule(void) {
     
     // Update statistics
     stats.context_switches++;
-    stats.running_processes = ready_queue.count + 1;
+    stats.running_processes = ready_count + 1;
     
-    // Load context
-    load_context(next_process);
-    
-    // Switch virtual memory if needed
-    if (next_process->page_directory) {
-        vmm_switch_page_directory(next_process->page_directory);
-    }
+    context_switch(previous_process, next_process);
     
-    serial_write_string("Scheduled process: ");
-    serial_write_string(next_process->name);
-    serial_write_string("\n");
+    // Back on previous_process's stack, possibly much later
+    scheduler_finish_switch();
+    irq_restore(flags);
 }
 
 // Timer tick for preemptive scheduling
@@ -172,12 +217,72 @@ void scheduler_tick(void) {
     current_process->time_used++;
     current_process->total_time++;
     
-    // Check if time slice expired
-    if (current_process->time_used >= current_process->time_slice) {
+    scheduler_age();
+    
+    // Idle gives way as soon as anything is ready
+    if (current_process == idle_process) {
+        stats.idle_time++;
+        if (ready_bitmap) {
+            scheduler_schedule();
+        }
+        return;
+    }
+    
+    // Preempt on slice expiry, or at once if a higher level has work
+    uint32_t higher_levels = (1 << current_process->sched_level) - 1;
+    if (current_process->time_used >= current_process->time_slice ||
+        (ready_bitmap & higher_levels)) {
         scheduler_yield();
     }
 }
 
+// Whether scheduler_block would actually switch away from the caller
+int scheduler_can_block(void) {
+    return scheduler_enabled && current_process && current_process != idle_process;
+}
+
+// Put the current process to sleep until scheduler_wake; the caller has
+// already recorded what it is waiting for, with interrupts off
+void scheduler_block(void) {
+    if (!scheduler_can_block()) {
+        return;
+    }
+    
+    current_process->state = PROCESS_STATE_BLOCKED;
+    stats.blocks++;
+    scheduler_schedule();
+}
+
+// Make a blocked process runnable again; safe from interrupt handlers
+void scheduler_wake(process_t* process) {
+    if (!process || process->state != PROCESS_STATE_BLOCKED) {
+        return;
+    }
+    
+    uint32_t flags = irq_save();
+    scheduler_enqueue(process);
+    irq_restore(flags);
+}
+
+// Charge ticks that passed without a timer interrupt to the current process
+void scheduler_account_ticks(uint32_t ticks) {
+    if (!scheduler_enabled || !current_process) {
+        return;
+    }
+    
+    stats.time_slices += ticks;
+    current_process->time_used += ticks;
+    current_process->total_time += ticks;
+    if (current_process == idle_process) {
+        stats.idle_time += ticks;
+    }
+}
+
+// Number of processes waiting to run
+uint32_t scheduler_ready_count(void) {
+    return ready_count;
+}
+
 // Yield CPU to next process
 void scheduler_yield(void) {
     if (!scheduler_enabled) {
@@ -203,8 +308,20 @@ void scheduler_print_stats(void) {
     serial_write_string(buffer);
     serial_write_string("\n");
     
-    serial_write_string("Ready queue count: ");
-    itoa(ready_queue.count, buffer, 10);
+    serial_write_string("Ready (high/normal/low): ");
+    for (uint32_t level = 0; level < SCHED_LEVELS; level++) {
+        itoa(run_queues[level].count, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string(level + 1 < SCHED_LEVELS ? "/" : "\n");
+    }
+    
+    serial_write_string("Blocked waits: ");
+    itoa(stats.blocks, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("\n");
+    
+    serial_write_string("Aging promotions: ");
+    itoa(stats.promotions, buffer, 10);
     serial_write_string(buffer);
     serial_write_string("\n");
     
@@ -230,33 +347,193 @@ void scheduler_print_stats(void) {
         itoa(current_process->pid, buffer, 10);
         serial_write_string(buffer);
         serial_write_string(")\n");
+        
+        serial_write_string("Regions: ");
+        itoa(current_process->vma_count, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string(", pages faulted in: ");
+        itoa(current_process->page_faults, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("\n");
     }
     
     serial_write_string("============================\n");
 }
 
-// Context switching functions (simplified for now)
-void save_context(process_t* process) {
-    if (!process) return;
-    
-    // Simplified context saving - just save general purpose registers
-    // In a real implementation, this would be done in the interrupt handler
-    process->eax = 0;  // These would be saved during interrupt
-    process->ebx = 0;
-    process->ecx = 0;
-    process->edx = 0;
-    process->esi = 0;
-    process->edi = 0;
-    process->esp = 0;  // Would be saved from current stack
-    process->ebp = 0;
-    process->eflags = 0x202; // Default flags with interrupts enabled
+// Switch kernel stacks (and address spaces) from one process to another.
+// Returns when something switches back to "from"
+void context_switch(process_t* from, process_t* to) {
+    // Kernel threads run in the kernel directory; skip the CR3 reload
+    // entirely when both sides share an address space
+    page_directory_t* dir = to->page_directory ? to->page_directory : vmm_get_kernel_directory();
+    if (dir != vmm_get_current_directory()) {
+        vmm_switch_page_directory(dir);
+    }
+    
+    context_switch_asm(&from->kernel_esp, to->kernel_esp);
+}
+
+// Runs on the incoming side of every switch: free a process that exited,
+// now that nothing is executing on its kernel stack
+void scheduler_finish_switch(void) {
+    if (zombie_process) {
+        process_t* zombie = zombie_process;
+        zombie_process = NULL;
+        process_destroy(zombie);
+    }
+}
+
+// Runs when nothing else is ready: pre-zeroes frames, then halts with the
+// tick stopped until the next deadline or interrupt, then hands over to
+// anything it woke
+static void idle_thread(void) {
+    while (1) {
+        if (pmm_zero_pool_refill(PMM_ZERO_BATCH) == 0) {
+            timer_idle();
+        }
+        if (ready_count) {
+            scheduler_yield();
+        }
+    }
 }
 
-void load_context(process_t* process) {
-    if (!process) return;
-    
-    // Simplified context loading - in real implementation this would
-    // restore registers and jump to the process
-    // For now, just mark that we've "loaded" the context
-    process->state = PROCESS_STATE_RUNNING;
-} 
\ No newline at end of file
+// Benchmark threads ping-pong through scheduler_yield until the shared
+// budget of switches is spent
+static volatile uint32_t bench_remaining = 0;
+static volatile uint32_t bench_running = 0;
+
+static void bench_thread(void) {
+    while (bench_remaining > 0) {
+        bench_remaining--;
+        scheduler_yield();
+    }
+    bench_running--;
+}
+
+// Measure context switches per second between two kernel threads
+void scheduler_benchmark(void) {
+    char buffer[32];
+    const uint32_t budget = 20000;
+    
+    bench_remaining = budget;
+    bench_running = 2;
+    
+    // Same priority as the caller so all three take turns
+    uint32_t priority = current_process->priority;
+    process_t* a = process_create_thread("bench-a", bench_thread, priority);
+    process_t* b = process_create_thread("bench-b", bench_thread, priority);
+    if (!a || !b) {
+        serial_write_string("SCHED ERROR: No processes for benchmark\n");
+        bench_remaining = 0;
+        process_destroy(a);
+        process_destroy(b);
+        return;
+    }
+    
+    uint32_t switches_before = stats.context_switches;
+    uint32_t ticks_before = timer_ticks;
+    uint64_t start = rdtsc();
+    
+    scheduler_add_process(a);
+    scheduler_add_process(b);
+    
+    // The shell takes part in the rotation until both threads are gone
+    while (bench_running > 0) {
+        scheduler_yield();
+    }
+    
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    uint32_t switches = stats.context_switches - switches_before;
+    uint32_t elapsed = timer_ticks - ticks_before;
+    
+    serial_write_string("\n=== CONTEXT SWITCH BENCHMARK ===\n");
+    serial_write_string("Switches: ");
+    itoa(switches, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" in ");
+    itoa(elapsed, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" ms\n");
+    
+    if (elapsed) {
+        serial_write_string("Switches per second: ");
+        itoa(switches / elapsed * 1000 + (switches % elapsed) * 1000 / elapsed, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("\n");
+    }
+    
+    if (switches) {
+        serial_write_string("Cycles per switch: ");
+        itoa(cycles / switches, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("\n");
+    }
+    
+    serial_write_string("================================\n");
+}
+
+// Sleepers for the idle benchmark: each naps a different length of time
+#define SLEEP_BENCH_THREADS 16
+#define SLEEP_BENCH_ROUNDS  10
+static volatile uint32_t sleepers_running = 0;
+static volatile uint32_t sleeper_next_id = 0;
+
+static void sleeper_thread(void) {
+    uint32_t nap = 5 + (sleeper_next_id++) * 3;
+    for (uint32_t i = 0; i < SLEEP_BENCH_ROUNDS; i++) {
+        timer_sleep(nap);
+    }
+    sleepers_running--;
+}
+
+// Run many sleeping processes and report how much of the time the CPU
+// spent in the idle thread
+void scheduler_sleep_benchmark(void) {
+    char buffer[32];
+    
+    sleepers_running = 0;
+    sleeper_next_id = 0;
+    
+    uint32_t idle_before = stats.idle_time;
+    uint32_t blocks_before = stats.blocks;
+    uint32_t ticks_before = timer_ticks;
+    
+    for (uint32_t i = 0; i < SLEEP_BENCH_THREADS; i++) {
+        process_t* sleeper = process_create_thread("sleeper", sleeper_thread, PROCESS_PRIORITY_NORMAL);
+        if (!sleeper) {
+            break;
+        }
+        sleepers_running++;
+        scheduler_add_process(sleeper);
+    }
+    
+    // The shell sleeps too, so only the idle thread is left to run
+    while (sleepers_running > 0) {
+        timer_sleep(10);
+    }
+    
+    uint32_t elapsed = timer_ticks - ticks_before;
+    uint32_t idle = stats.idle_time - idle_before;
+    
+    serial_write_string("\n=== SLEEP BENCHMARK ===\n");
+    serial_write_string("Sleepers: ");
+    itoa(sleeper_next_id, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(", blocked waits: ");
+    itoa(stats.blocks - blocks_before, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("\nElapsed: ");
+    itoa(elapsed, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" ms, idle: ");
+    itoa(idle, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" ms");
+    if (elapsed) {
+        serial_write_string(" (");
+        itoa(idle * 100 / elapsed, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("%)");
+    }
+    serial_write_string("\n=======================\n");
+}
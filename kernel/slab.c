@@ -0,0 +1,257 @@
+#include "../include/memory.h"
+#include "../include/libc/string.h"
+#include "../include/serial.h"
+#include "../include/utils.h"
+#include "../include/cpu.h"
+
+// Slab magic number for corruption detection
+#define SLAB_MAGIC 0x51AB51AB
+
+// Objects are padded to keep every object 8-byte aligned
+#define SLAB_ALIGN 8
+
+// Cache of kmem_cache_t descriptors (bootstraps every other cache)
+static kmem_cache_t cache_cache;
+static kmem_cache_t* cache_list = NULL;
+static int slab_initialized = 0;
+
+// Slab that owns an object: every slab is exactly one page
+#define SLAB_OF(obj) ((kmem_slab_t*)((uint32_t)(obj) & ~(PAGE_SIZE - 1)))
+
+// Unlink a slab from a cache list
+static void slab_list_remove(kmem_slab_t** list, kmem_slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+    
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+// Push a slab onto a cache list
+static void slab_list_push(kmem_slab_t** list, kmem_slab_t* slab) {
+    slab->prev = NULL;
+    slab->next = *list;
+    
+    if (*list) {
+        (*list)->prev = slab;
+    }
+    
+    *list = slab;
+}
+
+// Fill in a cache descriptor
+static void cache_setup(kmem_cache_t* cache, const char* name, size_t size, kmem_ctor_t ctor) {
+    memset(cache, 0, sizeof(kmem_cache_t));
+    strncpy(cache->name, name, KMEM_CACHE_NAME_LEN - 1);
+    cache->name[KMEM_CACHE_NAME_LEN - 1] = '\0';
+    
+    if (size < SLAB_ALIGN) {
+        size = SLAB_ALIGN;
+    }
+    cache->object_size = memory_align_up(size, SLAB_ALIGN);
+    cache->ctor = ctor;
+    
+    // Objects start right after the slab header
+    cache->first_object = memory_align_up(sizeof(kmem_slab_t), SLAB_ALIGN);
+    cache->objects_per_slab = (PAGE_SIZE - cache->first_object) / cache->object_size;
+    if (cache->objects_per_slab > KMEM_MAX_OBJECTS_PER_SLAB) {
+        cache->objects_per_slab = KMEM_MAX_OBJECTS_PER_SLAB;
+    }
+    
+    cache->next = cache_list;
+    cache_list = cache;
+}
+
+// Initialize the slab allocator
+void kmem_init(void) {
+    serial_write_string("Initializing slab allocator...\n");
+    
+    cache_setup(&cache_cache, "kmem_cache", sizeof(kmem_cache_t), NULL);
+    slab_initialized = 1;
+    
+    serial_write_string("Slab allocator initialized\n");
+}
+
+// Create a cache for fixed-size objects
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, kmem_ctor_t ctor) {
+    if (!slab_initialized || size == 0) {
+        return NULL;
+    }
+    
+    if (memory_align_up(size, SLAB_ALIGN) > PAGE_SIZE - memory_align_up(sizeof(kmem_slab_t), SLAB_ALIGN)) {
+        serial_write_string("SLAB ERROR: Object too large for a slab\n");
+        return NULL;
+    }
+    
+    kmem_cache_t* cache = (kmem_cache_t*)kmem_cache_alloc(&cache_cache);
+    if (!cache) {
+        return NULL;
+    }
+    
+    cache_setup(cache, name, size, ctor);
+    return cache;
+}
+
+// Grow a cache by one page-sized slab
+static kmem_slab_t* cache_grow(kmem_cache_t* cache) {
+    uint32_t frame = pmm_alloc_frame();
+    if (!frame) {
+        return NULL; // Out of memory
+    }
+    pmm_get_page(frame)->flags = PAGE_FLAG_KERNEL;
+    
+    kmem_slab_t* slab = (kmem_slab_t*)PHYS_TO_VIRT(frame);
+    memset(slab, 0, sizeof(kmem_slab_t));
+    slab->magic = SLAB_MAGIC;
+    slab->cache = cache;
+    slab->free_count = cache->objects_per_slab;
+    
+    // Mark every object free (1 = free)
+    for (uint32_t i = 0; i < cache->objects_per_slab; i++) {
+        slab->bitmap[i / 32] |= (1 << (i % 32));
+    }
+    
+    // Construct objects once; they keep their constructed state across free
+    if (cache->ctor) {
+        for (uint32_t i = 0; i < cache->objects_per_slab; i++) {
+            cache->ctor((char*)slab + cache->first_object + i * cache->object_size);
+        }
+    }
+    
+    slab_list_push(&cache->partial, slab);
+    cache->slab_count++;
+    
+    return slab;
+}
+
+// Allocate one object; caller has interrupts off
+static void* cache_alloc(kmem_cache_t* cache) {
+    if (!cache) {
+        return NULL;
+    }
+    
+    kmem_slab_t* slab = cache->partial;
+    if (!slab) {
+        slab = cache_grow(cache);
+        if (!slab) {
+            return NULL;
+        }
+    }
+    
+    // Find the first free object in the bitmap, one word at a time
+    uint32_t index = 0;
+    for (uint32_t word = 0; word < KMEM_SLAB_BITMAP_WORDS; word++) {
+        if (slab->bitmap[word]) {
+            index = word * 32 + __builtin_ctz(slab->bitmap[word]);
+            break;
+        }
+    }
+    
+    slab->bitmap[index / 32] &= ~(1 << (index % 32));
+    slab->free_count--;
+    
+    // Full slabs leave the partial list
+    if (slab->free_count == 0) {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_push(&cache->full, slab);
+    }
+    
+    cache->active_objects++;
+    cache->total_allocs++;
+    
+    return (char*)slab + cache->first_object + index * cache->object_size;
+}
+
+// Return an object; caller has interrupts off
+static void cache_free(kmem_cache_t* cache, void* obj) {
+    if (!cache || !obj) {
+        return;
+    }
+    
+    kmem_slab_t* slab = SLAB_OF(obj);
+    if (slab->magic != SLAB_MAGIC || slab->cache != cache) {
+        serial_write_string("SLAB ERROR: Object does not belong to cache\n");
+        return;
+    }
+    
+    uint32_t offset = (uint32_t)obj - (uint32_t)slab - cache->first_object;
+    uint32_t index = offset / cache->object_size;
+    if (offset % cache->object_size != 0 || index >= cache->objects_per_slab) {
+        serial_write_string("SLAB ERROR: Misaligned object in free\n");
+        return;
+    }
+    
+    if (slab->bitmap[index / 32] & (1 << (index % 32))) {
+        serial_write_string("SLAB ERROR: Double free detected\n");
+        return;
+    }
+    
+    // Full slab becomes partial again
+    if (slab->free_count == 0) {
+        slab_list_remove(&cache->full, slab);
+        slab_list_push(&cache->partial, slab);
+    }
+    
+    slab->bitmap[index / 32] |= (1 << (index % 32));
+    slab->free_count++;
+    cache->active_objects--;
+    cache->total_frees++;
+    
+    // Give an empty slab back to the PMM, but keep one around to avoid thrashing
+    if (slab->free_count == cache->objects_per_slab &&
+        (cache->partial != slab || slab->next)) {
+        slab_list_remove(&cache->partial, slab);
+        slab->magic = 0;
+        cache->slab_count--;
+        pmm_free_frame(VIRT_TO_PHYS(slab));
+    }
+}
+
+// Allocate one object from a cache
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    uint32_t flags = irq_save();
+    void* obj = cache_alloc(cache);
+    irq_restore(flags);
+    return obj;
+}
+
+// Return an object to its cache
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    uint32_t flags = irq_save();
+    cache_free(cache, obj);
+    irq_restore(flags);
+}
+
+// Print per-cache statistics
+void kmem_print_stats(void) {
+    char buffer[32];
+    
+    serial_write_string("\n=== SLAB CACHES ===\n");
+    serial_write_string("name: objsize active/total slabs\n");
+    
+    for (kmem_cache_t* cache = cache_list; cache; cache = cache->next) {
+        serial_write_string(cache->name);
+        serial_write_string(": ");
+        itoa(cache->object_size, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string(" ");
+        itoa(cache->active_objects, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("/");
+        itoa(cache->slab_count * cache->objects_per_slab, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string(" ");
+        itoa(cache->slab_count, buffer, 10);
+        serial_write_string(buffer);
+        serial_write_string("\n");
+    }
+    
+    serial_write_string("===================\n");
+}
@@ -0,0 +1,29 @@
+[bits 32]
+
+; switch.asm - Kernel stack switching for the scheduler
+
+section .text
+
+; void context_switch_asm(uint32_t* save_esp, uint32_t load_esp)
+; Pushes the callee-saved registers, stores ESP through save_esp, then loads
+; load_esp and pops the registers saved there. The caller's EIP is already on
+; the stack as our return address, so "ret" resumes the other process where
+; it last called in (or in process_start for a brand new one)
+global context_switch_asm
+context_switch_asm:
+    mov eax, [esp + 4]  ; Where to save the outgoing stack pointer
+    mov edx, [esp + 8]  ; Stack pointer of the incoming process
+    
+    push ebp
+    push ebx
+    push esi
+    push edi
+    
+    mov [eax], esp      ; Save outgoing ESP
+    mov esp, edx        ; Switch kernel stacks
+    
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
@@ -0,0 +1,293 @@
+#include "../include/sync.h"
+#include "../include/cpu.h"
+#include "../include/serial.h"
+#include "../include/utils.h"
+#include "../include/timer.h"
+
+// Initialize an empty wait queue
+void wait_queue_init(wait_queue_t* queue) {
+    queue->head = NULL;
+    queue->tail = NULL;
+}
+
+// Block the current process on a queue until woken. Before the scheduler
+// runs, or on the idle thread, there is nothing to switch to, so just wait
+// for an interrupt instead of queueing a process that never leaves the CPU
+void wait_queue_sleep(wait_queue_t* queue) {
+    if (!is_multitasking_enabled() || !scheduler_can_block()) {
+        asm volatile ("sti; hlt; cli");
+        return;
+    }
+    
+    process_t* process = current_process;
+    process->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = process;
+    } else {
+        queue->head = process;
+    }
+    queue->tail = process;
+    process->wait_queue = queue;
+    
+    scheduler_block();
+}
+
+// Wake the longest waiter; returns 1 if there was one
+int wait_queue_wake_one(wait_queue_t* queue) {
+    uint32_t flags = irq_save();
+    
+    process_t* process = queue->head;
+    if (!process) {
+        irq_restore(flags);
+        return 0;
+    }
+    
+    queue->head = process->next;
+    if (!queue->head) {
+        queue->tail = NULL;
+    }
+    process->next = NULL;
+    process->wait_queue = NULL;
+    scheduler_wake(process);
+    
+    irq_restore(flags);
+    return 1;
+}
+
+// Wake every waiter; returns how many were woken
+uint32_t wait_queue_wake_all(wait_queue_t* queue) {
+    uint32_t woken = 0;
+    while (wait_queue_wake_one(queue)) {
+        woken++;
+    }
+    return woken;
+}
+
+// Take a process off whatever queue it waits on before it is destroyed
+void wait_queue_cancel(process_t* process) {
+    uint32_t flags = irq_save();
+    
+    wait_queue_t* queue = process->wait_queue;
+    if (queue) {
+        process_t* previous = NULL;
+        for (process_t* p = queue->head; p; previous = p, p = p->next) {
+            if (p != process) {
+                continue;
+            }
+            
+            if (previous) {
+                previous->next = p->next;
+            } else {
+                queue->head = p->next;
+            }
+            if (queue->tail == p) {
+                queue->tail = previous;
+            }
+            break;
+        }
+        
+        process->next = NULL;
+        process->wait_queue = NULL;
+    }
+    
+    irq_restore(flags);
+}
+
+// Owner recorded for locks taken before any process exists, so a held
+// mutex never looks free just because current_process is NULL
+#define MUTEX_OWNER_BOOT ((process_t*)1)
+
+static process_t* mutex_self(void) {
+    return current_process ? current_process : MUTEX_OWNER_BOOT;
+}
+
+// Initialize an unlocked mutex
+void mutex_init(mutex_t* mutex) {
+    mutex->owner = NULL;
+    wait_queue_init(&mutex->waiters);
+}
+
+// Acquire a mutex, sleeping while another process holds it
+void mutex_lock(mutex_t* mutex) {
+    uint32_t flags = irq_save();
+    while (mutex->owner) {
+        wait_queue_sleep(&mutex->waiters);
+    }
+    mutex->owner = mutex_self();
+    irq_restore(flags);
+}
+
+// Acquire a mutex if it is free; returns 1 on success
+int mutex_trylock(mutex_t* mutex) {
+    uint32_t flags = irq_save();
+    int acquired = (mutex->owner == NULL);
+    if (acquired) {
+        mutex->owner = mutex_self();
+    }
+    irq_restore(flags);
+    return acquired;
+}
+
+// Release a mutex and wake one waiter
+void mutex_unlock(mutex_t* mutex) {
+    uint32_t flags = irq_save();
+    
+    if (mutex->owner != mutex_self()) {
+        serial_write_string("SYNC ERROR: Mutex unlocked by a process that does not hold it\n");
+        irq_restore(flags);
+        return;
+    }
+    
+    mutex->owner = NULL;
+    wait_queue_wake_one(&mutex->waiters);
+    irq_restore(flags);
+}
+
+// Initialize a semaphore with a starting count
+void semaphore_init(semaphore_t* sem, int32_t count) {
+    sem->count = count;
+    wait_queue_init(&sem->waiters);
+}
+
+// Take one unit, sleeping until one is available
+void semaphore_wait(semaphore_t* sem) {
+    uint32_t flags = irq_save();
+    while (sem->count <= 0) {
+        wait_queue_sleep(&sem->waiters);
+    }
+    sem->count--;
+    irq_restore(flags);
+}
+
+// Take one unit if available; returns 1 on success
+int semaphore_trywait(semaphore_t* sem) {
+    uint32_t flags = irq_save();
+    int taken = (sem->count > 0);
+    if (taken) {
+        sem->count--;
+    }
+    irq_restore(flags);
+    return taken;
+}
+
+// Return one unit and wake one waiter; safe from interrupt handlers
+void semaphore_signal(semaphore_t* sem) {
+    uint32_t flags = irq_save();
+    sem->count++;
+    wait_queue_wake_one(&sem->waiters);
+    irq_restore(flags);
+}
+
+// Initialize a condition variable
+void condition_init(condition_t* cond) {
+    wait_queue_init(&cond->waiters);
+}
+
+// Release the mutex and sleep until signalled, then re-acquire it. With
+// interrupts off between the two, a signal cannot slip in unseen
+void condition_wait(condition_t* cond, mutex_t* mutex) {
+    uint32_t flags = irq_save();
+    mutex_unlock(mutex);
+    wait_queue_sleep(&cond->waiters);
+    irq_restore(flags);
+    
+    mutex_lock(mutex);
+}
+
+// Wake one waiter
+void condition_signal(condition_t* cond) {
+    wait_queue_wake_one(&cond->waiters);
+}
+
+// Wake every waiter
+void condition_broadcast(condition_t* cond) {
+    wait_queue_wake_all(&cond->waiters);
+}
+
+// Bounded buffer shared by the self-test producer and consumer
+#define SYNC_TEST_SLOTS 4
+#define SYNC_TEST_ITEMS 1000
+
+static mutex_t test_lock;
+static condition_t test_not_full;
+static condition_t test_not_empty;
+static semaphore_t test_done;
+static uint32_t test_buffer[SYNC_TEST_SLOTS];
+static uint32_t test_count;
+static uint32_t test_head;
+static uint32_t test_sum;
+
+static void sync_test_producer(void) {
+    for (uint32_t item = 1; item <= SYNC_TEST_ITEMS; item++) {
+        mutex_lock(&test_lock);
+        while (test_count == SYNC_TEST_SLOTS) {
+            condition_wait(&test_not_full, &test_lock);
+        }
+        test_buffer[(test_head + test_count) % SYNC_TEST_SLOTS] = item;
+        test_count++;
+        condition_signal(&test_not_empty);
+        mutex_unlock(&test_lock);
+    }
+    semaphore_signal(&test_done);
+}
+
+static void sync_test_consumer(void) {
+    for (uint32_t i = 0; i < SYNC_TEST_ITEMS; i++) {
+        mutex_lock(&test_lock);
+        while (test_count == 0) {
+            condition_wait(&test_not_empty, &test_lock);
+        }
+        test_sum += test_buffer[test_head];
+        test_head = (test_head + 1) % SYNC_TEST_SLOTS;
+        test_count--;
+        condition_signal(&test_not_full);
+        mutex_unlock(&test_lock);
+    }
+    semaphore_signal(&test_done);
+}
+
+// Pass items through a 4-slot buffer between two kernel threads; the shell
+// sleeps on a semaphore until both finish
+void sync_self_test(void) {
+    char buffer[16];
+    
+    mutex_init(&test_lock);
+    condition_init(&test_not_full);
+    condition_init(&test_not_empty);
+    semaphore_init(&test_done, 0);
+    test_count = 0;
+    test_head = 0;
+    test_sum = 0;
+    
+    process_t* producer = process_create_thread("producer", sync_test_producer, PROCESS_PRIORITY_NORMAL);
+    process_t* consumer = process_create_thread("consumer", sync_test_consumer, PROCESS_PRIORITY_NORMAL);
+    if (!producer || !consumer) {
+        serial_write_string("SYNC ERROR: No processes for self-test\n");
+        process_destroy(producer);
+        process_destroy(consumer);
+        return;
+    }
+    
+    uint32_t ticks_before = timer_ticks;
+    scheduler_add_process(consumer);
+    scheduler_add_process(producer);
+    
+    semaphore_wait(&test_done);
+    semaphore_wait(&test_done);
+    
+    uint32_t expected = SYNC_TEST_ITEMS * (SYNC_TEST_ITEMS + 1) / 2;
+    
+    serial_write_string("\n=== SYNC SELF-TEST ===\n");
+    serial_write_string("Items: ");
+    itoa(SYNC_TEST_ITEMS, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(", sum: ");
+    itoa(test_sum, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(test_sum == expected ? " (correct)\n" : " (SYNC ERROR: wrong sum)\n");
+    serial_write_string("Elapsed: ");
+    itoa(timer_ticks - ticks_before, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" ms\n");
+    serial_write_string("======================\n");
+}
@@ -124,6 +124,18 @@ void syscall_handler(registers_t regs) {
             result = (int32_t)kernel_time();
             break;
             
+        case SYS_SPAWN_COW:
+            result = kernel_spawn_cow();
+            break;
+            
+        case SYS_MMAP:
+            result = (int32_t)kernel_mmap(arg1);
+            break;
+            
+        case SYS_MUNMAP:
+            result = kernel_munmap((void*)arg1, arg2);
+            break;
+            
         default:
             current_errno = EINVAL;  // Invalid system call
             result = -1;
@@ -236,7 +248,7 @@ void* kernel_malloc(uint32_t size) {
         return NULL;
     }
     
-    void* ptr = heap_malloc(size);
+    void* ptr = heap_malloc_tagged(size, HEAP_TAG_SYSCALL);
     if (!ptr) {
         current_errno = ENOMEM;
     }
@@ -265,14 +277,8 @@ int32_t kernel_sleep(uint32_t seconds) {
         return 0;
     }
     
-    // Get current time
-    uint32_t start_time = timer_get_ticks();
-    uint32_t target_time = start_time + (seconds * 1000);  // 1000 Hz timer
-    
-    // Busy wait (in a real OS, this would yield to other processes)
-    while (timer_get_ticks() < target_time) {
-        asm("hlt");  // Halt until next interrupt
-    }
+    // Blocks in the timer wheel; 1000 Hz timer
+    timer_sleep(seconds * 1000);
     
     return 0;
 }
@@ -384,6 +390,44 @@ uint32_t kernel_time(void) {
     return timer_get_ticks() / 1000;  // Convert from ms to seconds
 }
 
+// SYS_SPAWN_COW: start a child on a copy-on-write copy of the caller's
+// address space. The child begins at the caller's entry point rather than
+// returning here, so only the caller sees a return value (the child's PID)
+int32_t kernel_spawn_cow(void) {
+    process_t* child = process_spawn_cow(current_process);
+    if (!child) {
+        current_errno = current_process && current_process->page_directory ? ENOMEM : EINVAL;
+        return -1;
+    }
+    
+    scheduler_add_process(child);
+    return (int32_t)child->pid;
+}
+
+void* kernel_mmap(uint32_t length) {
+    if (length == 0) {
+        current_errno = EINVAL;
+        return NULL;
+    }
+    
+    // Only reserves address space; frames arrive through page faults
+    uint32_t addr = current_process ? vma_mmap(current_process, length) : 0;
+    if (!addr) {
+        current_errno = ENOMEM;
+    }
+    
+    return (void*)addr;
+}
+
+int32_t kernel_munmap(void* addr, uint32_t length) {
+    if (!current_process || vma_munmap(current_process, (uint32_t)addr, length) != 0) {
+        current_errno = EINVAL;
+        return -1;
+    }
+    
+    return 0;
+}
+
 // Utility function to get current errno
 uint32_t get_errno(void) {
     return current_errno;
@@ -400,7 +444,7 @@ void syscall_print_stats(void) {
         "exit", "read", "write", "open", "close", "malloc", "free", "getpid",
         "sleep", "fork", "exec", "wait", "kill", "chdir", "getcwd", "mkdir",
         "rmdir", "unlink", "stat", "time", "sbrk", "mmap", "munmap", "getuid",
-        "setuid", "signal", "ioctl", "seek", "dup", "pipe"
+        "setuid", "signal", "ioctl", "seek", "dup", "pipe", "spawn_cow"
     };
     
     for (uint32_t i = 0; i < SYS_MAX; i++) {
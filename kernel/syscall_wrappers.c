@@ -77,6 +77,16 @@ void* sys_malloc(uint32_t size) {
     return result;
 }
 
+// Anonymous mapping; the kernel picks the address
+void* sys_mmap(uint32_t length) {
+    void* result;
+    asm volatile ("int $0x80"
+                  : "=a" (result)
+                  : "a" (SYS_MMAP), "b" (length)
+                  : "memory");
+    return result;
+}
+
 // Generate system call wrappers using the macros
 SYSCALL1(exit, SYS_EXIT, int32_t)
 SYSCALL3(read, SYS_READ, int32_t, void*, uint32_t)
@@ -93,6 +103,8 @@ SYSCALL1(rmdir, SYS_RMDIR, const char*)
 SYSCALL1(unlink, SYS_UNLINK, const char*)
 SYSCALL2(stat, SYS_STAT, const char*, void*)
 SYSCALL0(time, SYS_TIME)
+SYSCALL0(spawn_cow, SYS_SPAWN_COW)
+SYSCALL2(munmap, SYS_MUNMAP, void*, uint32_t)
 
 // Test function to demonstrate system call usage
 void test_system_calls(void) {
@@ -0,0 +1,156 @@
+#include "../include/process.h"
+#include "../include/memory.h"
+#include "../include/isr.h"
+#include "../include/cpu.h"
+#include "../include/serial.h"
+
+// Round an address up to the next page boundary
+#define PAGE_ROUND_UP(addr) (((addr) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+// Region containing an address, or NULL
+vm_area_t* vma_find(process_t* process, uint32_t addr) {
+    for (uint32_t i = 0; i < process->vma_count; i++) {
+        vm_area_t* vma = &process->vmas[i];
+        if (addr >= vma->start && addr < vma->end) {
+            return vma;
+        }
+    }
+    return NULL;
+}
+
+// Add a region; returns 0 on success, -1 if it overlaps or the table is full
+int vma_add(process_t* process, uint32_t start, uint32_t end, uint32_t flags, uint32_t type) {
+    if (start >= end || (start & (PAGE_SIZE - 1)) || (end & (PAGE_SIZE - 1))) {
+        return -1;
+    }
+    
+    if (process->vma_count >= PROCESS_MAX_VMAS) {
+        serial_write_string("VMA ERROR: Region table full\n");
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < process->vma_count; i++) {
+        if (start < process->vmas[i].end && end > process->vmas[i].start) {
+            serial_write_string("VMA ERROR: Overlapping region\n");
+            return -1;
+        }
+    }
+    
+    vm_area_t* vma = &process->vmas[process->vma_count++];
+    vma->start = start;
+    vma->end = end;
+    vma->flags = flags | PAGE_PRESENT | PAGE_USER;
+    vma->type = type;
+    
+    return 0;
+}
+
+// Unmap every page that was faulted into a region
+static void vma_unmap_pages(process_t* process, uint32_t start, uint32_t end) {
+    vmm_unmap_range(process->page_directory, start, end - start);
+}
+
+// Reserve an anonymous region; pages appear on first touch
+uint32_t vma_mmap(process_t* process, uint32_t length) {
+    if (!process->page_directory || length == 0) {
+        return 0;
+    }
+    
+    length = PAGE_ROUND_UP(length);
+    uint32_t start = process->mmap_next;
+    if (start + length > KERNEL_VIRTUAL_BASE || start + length < start) {
+        return 0; // Out of address space
+    }
+    
+    if (vma_add(process, start, start + length, PAGE_WRITABLE, VMA_ANON) != 0) {
+        return 0;
+    }
+    
+    process->mmap_next = start + length;
+    return start;
+}
+
+// Remove an anonymous region; only whole regions returned by vma_mmap
+int vma_munmap(process_t* process, uint32_t addr, uint32_t length) {
+    vm_area_t* vma = vma_find(process, addr);
+    if (!vma || vma->type != VMA_ANON || vma->start != addr ||
+        vma->end != addr + PAGE_ROUND_UP(length)) {
+        return -1;
+    }
+    
+    vma_unmap_pages(process, vma->start, vma->end);
+    
+    // Keep the table dense: move the last entry into the hole
+    *vma = process->vmas[--process->vma_count];
+    return 0;
+}
+
+// Map a zeroed frame for a not-present fault inside a region
+static int vma_handle_fault(process_t* process, uint32_t addr, uint32_t err_code) {
+    vm_area_t* vma = vma_find(process, addr);
+    if (!vma) {
+        return -1; // Outside every region
+    }
+    
+    if ((err_code & PF_WRITE) && !(vma->flags & PAGE_WRITABLE)) {
+        return -1; // Write to a read-only region
+    }
+    
+    uint32_t frame = pmm_alloc_zeroed_frame();
+    if (!frame) {
+        serial_write_string("VMA ERROR: Out of memory in page fault\n");
+        return -1;
+    }
+    pmm_get_page(frame)->flags = PAGE_FLAG_USER;
+    
+    uint32_t page = addr & ~(PAGE_SIZE - 1);
+    if (vmm_map_page(process->page_directory, page, frame, vma->flags) != 0) {
+        pmm_frame_put(frame); // No memory for the page table
+        return -1;
+    }
+    
+    process->page_faults++;
+    return 0;
+}
+
+// Interrupt 14: resolve demand and copy-on-write faults, report everything else
+static void page_fault_handler(registers_t regs) {
+    uint32_t fault_addr = read_cr2();
+    process_t* process = current_process;
+    
+    if (!(regs.err_code & PF_PRESENT) && process && process->page_directory &&
+        vma_handle_fault(process, fault_addr, regs.err_code) == 0) {
+        return; // Retry the faulting instruction
+    }
+    
+    // Write to a page shared with a copy-on-write spawn
+    if ((regs.err_code & PF_PRESENT) && (regs.err_code & PF_WRITE) && process &&
+        process->page_directory && vma_find(process, fault_addr) &&
+        vmm_resolve_cow(process->page_directory, fault_addr) == 0) {
+        return;
+    }
+    
+    serial_write_string("PAGE FAULT: address ");
+    serial_write_hex(fault_addr);
+    serial_write_string(" eip ");
+    serial_write_hex(regs.eip);
+    serial_write_string(" error ");
+    serial_write_dec(regs.err_code);
+    if (process) {
+        serial_write_string(" in ");
+        serial_write_string(process->name);
+    }
+    serial_write_string("\n");
+    
+    // The faulting instruction cannot make progress
+    serial_write_string("System halted\n");
+    while (1) {
+        asm volatile ("cli; hlt");
+    }
+}
+
+// Install the page-fault handler
+void vma_init(void) {
+    register_interrupt_handler(14, page_fault_handler);
+    serial_write_string("Demand paging enabled (INT 14)\n");
+}
@@ -1,15 +1,24 @@
 #include "../include/memory.h"
 #include "../include/libc/string.h"
 #include "../include/serial.h"
+#include "../include/utils.h"
+#include "../include/cpu.h"
 
 // Current page directory
 static page_directory_t* current_page_directory = NULL;
 static page_directory_t kernel_page_directory;
 
+// Set once CR4.PSE is on and 4MB directory entries can be used
+static int vmm_large_pages = 0;
+
+// Set once CR4.PGE is on; PAGE_GLOBAL entries then survive CR3 reloads
+static int vmm_global_pages = 0;
+
 // Assembly functions for paging (we'll need to implement these)
 extern void vmm_load_page_directory(uint32_t page_dir_physical);
 extern void vmm_enable_paging_asm(void);
 extern void vmm_flush_tlb(void);
+extern void vmm_invalidate_page(uint32_t virtual_addr);
 
 // Get page directory index from virtual address
 #define GET_PD_INDEX(addr) ((addr) >> 22)
@@ -20,6 +29,14 @@ extern void vmm_flush_tlb(void);
 // Get page-aligned address
 #define PAGE_ALIGN(addr) ((addr) & ~(PAGE_SIZE - 1))
 
+// Page table behind a directory entry, through the linear map
+static inline page_table_t* vmm_table(page_directory_entry_t* pde) {
+    return (page_table_t*)PHYS_TO_VIRT(pde->address << 12);
+}
+
+// True when an address sits on a 4MB boundary
+#define LARGE_ALIGNED(addr) (((addr) & (LARGE_PAGE_SIZE - 1)) == 0)
+
 // Initialize virtual memory manager
 void vmm_init(void) {
     serial_write_string("Initializing Virtual Memory Manager...\n");
@@ -27,18 +44,41 @@ void vmm_init(void) {
     // Clear kernel page directory
     memset(&kernel_page_directory, 0, sizeof(page_directory_t));
     
-    // Identity map first 4MB (kernel space)
-    // This ensures kernel code can continue running after paging is enabled
-    for (uint32_t addr = 0; addr < 0x400000; addr += PAGE_SIZE) {
-        vmm_map_page(&kernel_page_directory, addr, addr, 
-                     PAGE_PRESENT | PAGE_WRITABLE);
+    // 4MB pages need CR4.PSE, which must be set before paging is enabled
+    if (cpu_features_edx() & CPUID_FEAT_EDX_PSE) {
+        write_cr4(read_cr4() | CR4_PSE);
+        vmm_large_pages = 1;
     }
     
+    // Global kernel pages stay in the TLB across address-space switches
+    if (cpu_features_edx() & CPUID_FEAT_EDX_PGE) {
+        write_cr4(read_cr4() | CR4_PGE);
+        vmm_global_pages = 1;
+    }
+    
+    // Identity map all managed RAM (kernel image plus every PMM frame)
+    // This ensures kernel code can continue running after paging is enabled,
+    // and doubles as the physical linear map (PHYS_MAP_BASE is 0) through
+    // which page tables are edited. Every directory copies these entries.
+    // 4MB pages cover it where possible, so it costs no page tables
+    vmm_map_range(&kernel_page_directory, PHYS_MAP_BASE, 0, pmm_get_memory_end(),
+                  PAGE_PRESENT | PAGE_WRITABLE | PAGE_SIZE_FLAG | PAGE_GLOBAL);
+    
     // Map kernel virtual space to physical space
-    for (uint32_t addr = 0; addr < 0x400000; addr += PAGE_SIZE) {
-        vmm_map_page(&kernel_page_directory, KERNEL_VIRTUAL_BASE + addr, addr,
-                     PAGE_PRESENT | PAGE_WRITABLE);
+    vmm_map_range(&kernel_page_directory, KERNEL_VIRTUAL_BASE, 0, LARGE_PAGE_SIZE,
+                  PAGE_PRESENT | PAGE_WRITABLE | PAGE_SIZE_FLAG | PAGE_GLOBAL);
+    
+    uint32_t large = 0;
+    for (int i = 0; i < PAGE_DIRECTORY_SIZE; i++) {
+        if (kernel_page_directory.entries[i].present && kernel_page_directory.entries[i].size) {
+            large++;
+        }
     }
+    char buffer[16];
+    serial_write_string("VMM: ");
+    itoa(large, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(vmm_large_pages ? " 4MB kernel pages\n" : " 4MB pages (PSE unsupported)\n");
     
     current_page_directory = &kernel_page_directory;
     
@@ -47,18 +87,19 @@ void vmm_init(void) {
 
 // Create a new page directory
 page_directory_t* vmm_create_page_directory(void) {
-    // Allocate physical frame for page directory
-    uint32_t page_dir_phys = pmm_alloc_frame();
+    // Allocate an already-zeroed frame for the page directory
+    uint32_t page_dir_phys = pmm_alloc_zeroed_frame();
     if (!page_dir_phys) {
         return NULL;
     }
+    pmm_get_page(page_dir_phys)->flags = PAGE_FLAG_KERNEL | PAGE_FLAG_PINNED;
     
-    page_directory_t* page_dir = (page_directory_t*)page_dir_phys;
-    
-    // Clear the page directory
-    memset(page_dir, 0, sizeof(page_directory_t));
+    page_directory_t* page_dir = (page_directory_t*)PHYS_TO_VIRT(page_dir_phys);
     
-    // Copy kernel mappings from current directory
+    // Copy kernel mappings: the identity-mapped low region and the higher half
+    for (int i = 0; i < GET_PD_INDEX(USER_VIRTUAL_BASE); i++) {
+        page_dir->entries[i] = kernel_page_directory.entries[i];
+    }
     for (int i = GET_PD_INDEX(KERNEL_VIRTUAL_BASE); i < PAGE_DIRECTORY_SIZE; i++) {
         page_dir->entries[i] = kernel_page_directory.entries[i];
     }
@@ -66,33 +107,182 @@ page_directory_t* vmm_create_page_directory(void) {
     return page_dir;
 }
 
+// Release user page tables below end_pd and the directory itself. Mapped
+// frames and the tables are handed back VMM_RELEASE_BATCH at a time;
+// frames still shared with a copy-on-write sibling only lose a reference
+static void vmm_release_user_space(page_directory_t* dir, uint32_t end_pd) {
+    uint32_t batch[VMM_RELEASE_BATCH];
+    uint32_t count = 0;
+    
+    for (uint32_t pd = GET_PD_INDEX(USER_VIRTUAL_BASE); pd < end_pd; pd++) {
+        if (!dir->entries[pd].present || dir->entries[pd].size) {
+            continue;
+        }
+        
+        page_table_t* table = vmm_table(&dir->entries[pd]);
+        for (uint32_t pt = 0; pt < PAGE_TABLE_SIZE; pt++) {
+            if (!table->entries[pt].present) {
+                continue;
+            }
+            batch[count++] = table->entries[pt].address << 12;
+            if (count == VMM_RELEASE_BATCH) {
+                pmm_frame_put_batch(batch, count);
+                count = 0;
+            }
+        }
+        
+        batch[count++] = VIRT_TO_PHYS(table);
+        if (count == VMM_RELEASE_BATCH) {
+            pmm_frame_put_batch(batch, count);
+            count = 0;
+        }
+    }
+    
+    batch[count++] = VIRT_TO_PHYS(dir);
+    pmm_frame_put_batch(batch, count);
+}
+
+// Tear down a user address space: every user frame, every user page table
+// and the directory. Kernel entries are shared and left alone
+void vmm_destroy_directory(page_directory_t* dir) {
+    if (!dir || dir == &kernel_page_directory) {
+        return;
+    }
+    
+    // Never free the tables the CPU is walking
+    if (dir == current_page_directory) {
+        vmm_switch_page_directory(&kernel_page_directory);
+    }
+    
+    vmm_release_user_space(dir, GET_PD_INDEX(KERNEL_VIRTUAL_BASE));
+}
+
+// Copy-on-write clone of an address space: the child gets its own page
+// tables, but every user frame is shared read-only with one extra reference.
+// Work is one table copy per page table, independent of resident memory
+page_directory_t* vmm_clone_directory(page_directory_t* src) {
+    page_directory_t* dir = vmm_create_page_directory();
+    if (!dir) {
+        return NULL;
+    }
+    
+    for (uint32_t pd = GET_PD_INDEX(USER_VIRTUAL_BASE); pd < GET_PD_INDEX(KERNEL_VIRTUAL_BASE); pd++) {
+        if (!src->entries[pd].present) {
+            continue;
+        }
+        
+        uint32_t table_phys = pmm_alloc_frame();
+        if (!table_phys) {
+            vmm_release_user_space(dir, pd);
+            return NULL;
+        }
+        pmm_get_page(table_phys)->flags = PAGE_FLAG_KERNEL | PAGE_FLAG_PINNED;
+        
+        page_table_t* parent = vmm_table(&src->entries[pd]);
+        page_table_t* child = (page_table_t*)PHYS_TO_VIRT(table_phys);
+        
+        // Write-protect the parent's entries first so both copies agree
+        for (uint32_t pt = 0; pt < PAGE_TABLE_SIZE; pt++) {
+            page_table_entry_t* entry = &parent->entries[pt];
+            if (!entry->present) {
+                continue;
+            }
+            if (entry->writable) {
+                entry->writable = 0;
+                entry->available |= PAGE_COW >> 9;
+            }
+            pmm_frame_get(entry->address << 12);
+        }
+        memcpy(child, parent, sizeof(page_table_t));
+        
+        dir->entries[pd] = src->entries[pd];
+        dir->entries[pd].address = table_phys >> 12;
+    }
+    
+    // The parent's writable translations may still be cached
+    if (src == current_page_directory) {
+        vmm_flush_tlb();
+    }
+    
+    return dir;
+}
+
+// Resolve a write fault on a copy-on-write page: the last sharer just gets
+// write access back, anyone else gets a private copy. Returns 0 if handled
+int vmm_resolve_cow(page_directory_t* dir, uint32_t virtual_addr) {
+    virtual_addr = PAGE_ALIGN(virtual_addr);
+    page_directory_entry_t* pde = &dir->entries[GET_PD_INDEX(virtual_addr)];
+    if (!pde->present || pde->size) {
+        return -1;
+    }
+    
+    page_table_t* page_table = vmm_table(pde);
+    page_table_entry_t* entry = &page_table->entries[GET_PT_INDEX(virtual_addr)];
+    if (!entry->present || !(entry->available & (PAGE_COW >> 9))) {
+        return -1; // A genuine protection fault
+    }
+    
+    uint32_t frame = entry->address << 12;
+    page_t* page = pmm_get_page(frame);
+    
+    if (!page || page->refcount > 1) {
+        uint32_t copy = pmm_alloc_frame();
+        if (!copy) {
+            serial_write_string("VMM ERROR: Out of memory copying a shared page\n");
+            return -1;
+        }
+        pmm_get_page(copy)->flags = PAGE_FLAG_USER;
+        memcpy(PHYS_TO_VIRT(copy), PHYS_TO_VIRT(frame), PAGE_SIZE);
+        
+        entry->address = copy >> 12;
+        pmm_frame_put(frame); // Drop this space's share of the original
+    }
+    
+    entry->available &= ~(PAGE_COW >> 9);
+    entry->writable = 1;
+    vmm_invalidate_page(virtual_addr);
+    
+    return 0;
+}
+
 // Switch to a different page directory
 void vmm_switch_page_directory(page_directory_t* dir) {
     current_page_directory = dir;
-    uint32_t dir_phys = (uint32_t)dir;
+    uint32_t dir_phys = VIRT_TO_PHYS(dir);
     vmm_load_page_directory(dir_phys);
 }
 
-// Map a virtual page to a physical page
-void vmm_map_page(page_directory_t* dir, uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
-    // Align addresses to page boundaries
-    virtual_addr = PAGE_ALIGN(virtual_addr);
-    physical_addr = PAGE_ALIGN(physical_addr);
-    
+// Get the page directory loaded in CR3
+page_directory_t* vmm_get_current_directory(void) {
+    return current_page_directory;
+}
+
+// Get the kernel page directory
+page_directory_t* vmm_get_kernel_directory(void) {
+    return &kernel_page_directory;
+}
+
+// Write one page table entry; returns 1 if a stale TLB entry may exist,
+// 0 if not, -1 if a page table could not be allocated
+static int vmm_set_entry(page_directory_t* dir, uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
     uint32_t pd_index = GET_PD_INDEX(virtual_addr);
     uint32_t pt_index = GET_PT_INDEX(virtual_addr);
     
+    // A 4MB entry has no page table to write into
+    if (dir->entries[pd_index].present && dir->entries[pd_index].size) {
+        serial_write_string("VMM ERROR: Address is inside a 4MB page\n");
+        return -1;
+    }
+    
     // Check if page table exists
     if (!(dir->entries[pd_index].present)) {
-        // Allocate new page table
-        uint32_t page_table_phys = pmm_alloc_frame();
+        // Allocate new page table; zeroed frames need no clearing
+        uint32_t page_table_phys = pmm_alloc_zeroed_frame();
         if (!page_table_phys) {
-            return; // Out of memory
+            return -1; // Out of memory
         }
         
-        // Clear the page table
-        page_table_t* page_table = (page_table_t*)page_table_phys;
-        memset(page_table, 0, sizeof(page_table_t));
+        pmm_get_page(page_table_phys)->flags = PAGE_FLAG_KERNEL | PAGE_FLAG_PINNED;
         
         // Set page directory entry
         dir->entries[pd_index].present = 1;
@@ -102,32 +292,37 @@ void vmm_map_page(page_directory_t* dir, uint32_t virtual_addr, uint32_t physica
     }
     
     // Get page table
-    page_table_t* page_table = (page_table_t*)(dir->entries[pd_index].address << 12);
+    page_table_t* page_table = vmm_table(&dir->entries[pd_index]);
+    
+    // Not-present entries are never cached, so only a live entry needs invlpg
+    int was_present = page_table->entries[pt_index].present;
     
     // Set page table entry
     page_table->entries[pt_index].present = (flags & PAGE_PRESENT) ? 1 : 0;
     page_table->entries[pt_index].writable = (flags & PAGE_WRITABLE) ? 1 : 0;
     page_table->entries[pt_index].user = (flags & PAGE_USER) ? 1 : 0;
+    page_table->entries[pt_index].global = ((flags & PAGE_GLOBAL) && vmm_global_pages) ? 1 : 0;
     page_table->entries[pt_index].address = physical_addr >> 12;
     
-    // Flush TLB for this page
-    vmm_flush_tlb();
+    return was_present;
 }
 
-// Unmap a virtual page
-void vmm_unmap_page(page_directory_t* dir, uint32_t virtual_addr) {
-    virtual_addr = PAGE_ALIGN(virtual_addr);
-    
+// Clear one page table entry and drop its frame reference; returns 1 if
+// the page was mapped
+static int vmm_clear_entry(page_directory_t* dir, uint32_t virtual_addr) {
     uint32_t pd_index = GET_PD_INDEX(virtual_addr);
     uint32_t pt_index = GET_PT_INDEX(virtual_addr);
     
-    // Check if page table exists
-    if (!(dir->entries[pd_index].present)) {
-        return; // Page not mapped
+    // Check if page table exists; 4MB kernel pages are never unmapped
+    if (!(dir->entries[pd_index].present) || dir->entries[pd_index].size) {
+        return 0; // Page not mapped
     }
     
     // Get page table
-    page_table_t* page_table = (page_table_t*)(dir->entries[pd_index].address << 12);
+    page_table_t* page_table = vmm_table(&dir->entries[pd_index]);
+    if (!page_table->entries[pt_index].present) {
+        return 0;
+    }
     
     // Get physical address before unmapping
     uint32_t physical_addr = page_table->entries[pt_index].address << 12;
@@ -135,13 +330,138 @@ void vmm_unmap_page(page_directory_t* dir, uint32_t virtual_addr) {
     // Clear page table entry
     memset(&page_table->entries[pt_index], 0, sizeof(page_table_entry_t));
     
-    // Free the physical frame
-    if (physical_addr) {
-        pmm_free_frame(physical_addr);
+    // Drop the mapping's reference; the frame is freed with the last one
+    pmm_frame_put(physical_addr);
+    
+    return 1;
+}
+
+// Point a directory entry straight at a 4MB frame; the entry must be empty
+static void vmm_set_large_entry(page_directory_t* dir, uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
+    page_directory_entry_t* entry = &dir->entries[GET_PD_INDEX(virtual_addr)];
+    
+    entry->present = (flags & PAGE_PRESENT) ? 1 : 0;
+    entry->writable = (flags & PAGE_WRITABLE) ? 1 : 0;
+    entry->user = (flags & PAGE_USER) ? 1 : 0;
+    entry->size = 1;
+    entry->global = ((flags & PAGE_GLOBAL) && vmm_global_pages) ? 1 : 0;
+    entry->address = physical_addr >> 12;
+}
+
+// Flush every TLB entry, global ones included; a CR3 reload alone keeps
+// global entries, so toggle CR4.PGE instead
+static void vmm_flush_tlb_all(void) {
+    if (vmm_global_pages) {
+        uint32_t cr4 = read_cr4();
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
+    } else {
+        vmm_flush_tlb();
+    }
+}
+
+// Map a virtual page to a physical page; returns 0, or -1 if no page
+// table could be allocated
+int vmm_map_page(page_directory_t* dir, uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
+    // Align addresses to page boundaries
+    virtual_addr = PAGE_ALIGN(virtual_addr);
+    physical_addr = PAGE_ALIGN(physical_addr);
+    
+    int status = vmm_set_entry(dir, virtual_addr, physical_addr, flags);
+    if (status < 0) {
+        return -1;
+    }
+    
+    // Drop just this page from the TLB if an old translation was live
+    if (status > 0) {
+        vmm_invalidate_page(virtual_addr);
+    }
+    return 0;
+}
+
+// Allocate every page table covering [start, end) up front, so directories
+// that copy these kernel entries later see all mappings made in the range.
+// Returns 0, or -1 if frames ran out
+int vmm_reserve_tables(page_directory_t* dir, uint32_t start, uint32_t end) {
+    for (uint32_t pd = GET_PD_INDEX(start); pd < GET_PD_INDEX(end - 1) + 1; pd++) {
+        if (dir->entries[pd].present) {
+            continue;
+        }
+        
+        uint32_t page_table_phys = pmm_alloc_zeroed_frame();
+        if (!page_table_phys) {
+            return -1;
+        }
+        pmm_get_page(page_table_phys)->flags = PAGE_FLAG_KERNEL | PAGE_FLAG_PINNED;
+        
+        dir->entries[pd].present = 1;
+        dir->entries[pd].writable = 1;
+        dir->entries[pd].address = page_table_phys >> 12;
     }
+    return 0;
+}
+
+// Unmap a virtual page
+void vmm_unmap_page(page_directory_t* dir, uint32_t virtual_addr) {
+    virtual_addr = PAGE_ALIGN(virtual_addr);
     
-    // Flush TLB for this page
-    vmm_flush_tlb();
+    if (vmm_clear_entry(dir, virtual_addr)) {
+        vmm_invalidate_page(virtual_addr);
+    }
+}
+
+// Map a contiguous range; stale translations are invalidated page by page
+// up to VMM_INVLPG_MAX, beyond that with a single CR3 reload at the end.
+// Returns 0, or -1 if page tables ran out (pages before the failure stay mapped)
+int vmm_map_range(page_directory_t* dir, uint32_t virtual_addr, uint32_t physical_addr, uint32_t size, uint32_t flags) {
+    virtual_addr = PAGE_ALIGN(virtual_addr);
+    physical_addr = PAGE_ALIGN(physical_addr);
+    
+    uint32_t stale = 0;
+    int result = 0;
+    
+    for (uint32_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        // Whole aligned 4MB stretches go straight into the directory
+        if ((flags & PAGE_SIZE_FLAG) && vmm_large_pages &&
+            LARGE_ALIGNED(virtual_addr + offset) && LARGE_ALIGNED(physical_addr + offset) &&
+            size - offset >= LARGE_PAGE_SIZE &&
+            !dir->entries[GET_PD_INDEX(virtual_addr + offset)].present) {
+            vmm_set_large_entry(dir, virtual_addr + offset, physical_addr + offset, flags);
+            offset += LARGE_PAGE_SIZE - PAGE_SIZE;
+            continue;
+        }
+        
+        int status = vmm_set_entry(dir, virtual_addr + offset, physical_addr + offset, flags);
+        if (status < 0) {
+            result = -1;
+            break;
+        }
+        if (status > 0 && ++stale <= VMM_INVLPG_MAX) {
+            vmm_invalidate_page(virtual_addr + offset);
+        }
+    }
+    
+    if (stale > VMM_INVLPG_MAX) {
+        vmm_flush_tlb_all();
+    }
+    
+    return result;
+}
+
+// Unmap a range, dropping frame references; flushes like vmm_map_range
+void vmm_unmap_range(page_directory_t* dir, uint32_t virtual_addr, uint32_t size) {
+    virtual_addr = PAGE_ALIGN(virtual_addr);
+    
+    uint32_t stale = 0;
+    for (uint32_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        if (vmm_clear_entry(dir, virtual_addr + offset) && ++stale <= VMM_INVLPG_MAX) {
+            vmm_invalidate_page(virtual_addr + offset);
+        }
+    }
+    
+    if (stale > VMM_INVLPG_MAX) {
+        vmm_flush_tlb_all();
+    }
 }
 
 // Get physical address for a virtual address
@@ -155,8 +475,13 @@ uint32_t vmm_get_physical_address(page_directory_t* dir, uint32_t virtual_addr)
         return 0; // Page not mapped
     }
     
+    // 4MB page: the low 22 bits are the offset
+    if (dir->entries[pd_index].size) {
+        return (dir->entries[pd_index].address << 12) | (virtual_addr & (LARGE_PAGE_SIZE - 1));
+    }
+    
     // Get page table
-    page_table_t* page_table = (page_table_t*)(dir->entries[pd_index].address << 12);
+    page_table_t* page_table = vmm_table(&dir->entries[pd_index]);
     
     // Check if page is mapped
     if (!(page_table->entries[pt_index].present)) {
@@ -177,4 +502,150 @@ void vmm_enable_paging(void) {
     vmm_enable_paging_asm();
     
     serial_write_string("VMM: Paging enabled successfully\n");
-} 
\ No newline at end of file
+} 
+
+// Touch one word in each page of a window, a few times over; returns cycles
+static uint32_t vmm_walk(uint32_t base, uint32_t size, uint32_t passes) {
+    uint64_t start = rdtsc();
+    for (uint32_t pass = 0; pass < passes; pass++) {
+        for (uint32_t offset = 0; offset < size; offset += PAGE_SIZE) {
+            // Stagger the word within the page so cache sets are spread out
+            volatile uint32_t* word = (volatile uint32_t*)(base + offset + ((offset >> 6) & (PAGE_SIZE - 64)));
+            (void)*word;
+        }
+    }
+    return (uint32_t)(rdtsc() - start);
+}
+
+// Compare page walks over the same 4MB of RAM through a 4MB page and
+// through 4KB pages; the difference is TLB miss cost
+void vmm_benchmark(void) {
+    char buffer[32];
+    const uint32_t passes = 8;
+    const uint32_t pages = LARGE_PAGE_SIZE / PAGE_SIZE;
+    
+    serial_write_string("\n=== VMM BENCHMARK ===\n");
+    
+    // A max-order buddy block is 4MB and naturally 4MB aligned
+    uint32_t block = pmm_alloc_frames(PMM_MAX_ORDER);
+    if (!block) {
+        serial_write_string("VMM ERROR: No free 4MB block for benchmark\n");
+        return;
+    }
+    
+    page_directory_t* dir = &kernel_page_directory;
+    uint32_t linear = (uint32_t)PHYS_TO_VIRT(block);
+    if (!vmm_large_pages || !dir->entries[GET_PD_INDEX(linear)].size) {
+        serial_write_string("Identity map does not use 4MB pages here\n");
+        pmm_free_frames(block, PMM_MAX_ORDER);
+        return;
+    }
+    
+    // Alias the block with 4KB pages; the alias holds no frame references
+    if (vmm_map_range(dir, KERNEL_SCRATCH_START, block, LARGE_PAGE_SIZE,
+                      PAGE_PRESENT | PAGE_WRITABLE) != 0) {
+        serial_write_string("VMM ERROR: Could not map benchmark window\n");
+        vmm_map_range(dir, KERNEL_SCRATCH_START, 0, LARGE_PAGE_SIZE, 0);
+        pmm_free_frames(block, PMM_MAX_ORDER);
+        return;
+    }
+    
+    // Warm the caches once so both walks see the same data cache state
+    vmm_walk(linear, LARGE_PAGE_SIZE, 1);
+    vmm_walk(KERNEL_SCRATCH_START, LARGE_PAGE_SIZE, 1);
+    
+    uint32_t large_cycles = vmm_walk(linear, LARGE_PAGE_SIZE, passes);
+    uint32_t small_cycles = vmm_walk(KERNEL_SCRATCH_START, LARGE_PAGE_SIZE, passes);
+    
+    // Clearing with flags 0 drops the entries without touching refcounts
+    vmm_map_range(dir, KERNEL_SCRATCH_START, 0, LARGE_PAGE_SIZE, 0);
+    pmm_free_frames(block, PMM_MAX_ORDER);
+    
+    serial_write_string("Pages touched per pass: ");
+    itoa(pages, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("\n");
+    
+    serial_write_string("4MB page: ");
+    itoa(large_cycles / (pages * passes), buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" cycles/page\n");
+    
+    serial_write_string("4KB pages: ");
+    itoa(small_cycles / (pages * passes), buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" cycles/page\n");
+    
+    serial_write_string("=====================\n");
+}
+
+// Time kernel accesses right after address-space switches, with global
+// pages off and then on; the kernel heap is the working set
+void vmm_switch_benchmark(void) {
+    char buffer[32];
+    const uint32_t rounds = 64;
+    const uint32_t size = KERNEL_HEAP_INITIAL; // Always mapped, never trimmed
+    const uint32_t pages = size / PAGE_SIZE;
+    
+    serial_write_string("\n=== CONTEXT SWITCH TLB BENCHMARK ===\n");
+    
+    if (!vmm_global_pages) {
+        serial_write_string("Global pages (PGE) not supported\n");
+        return;
+    }
+    
+    // Two address spaces standing in for two processes
+    page_directory_t* dirs[2];
+    dirs[0] = vmm_create_page_directory();
+    dirs[1] = vmm_create_page_directory();
+    if (!dirs[0] || !dirs[1]) {
+        serial_write_string("VMM ERROR: No memory for benchmark\n");
+        if (dirs[0]) {
+            pmm_frame_put(VIRT_TO_PHYS(dirs[0]));
+        }
+        return;
+    }
+    
+    uint32_t cycles[2];
+    uint32_t cr4 = read_cr4();
+    uint32_t flags = irq_save();
+    
+    for (int global = 0; global < 2; global++) {
+        // Clearing PGE flushes everything and makes the G bit inert
+        write_cr4(global ? cr4 : (cr4 & ~CR4_PGE));
+        vmm_walk(KERNEL_HEAP_START, size, 1);
+        
+        cycles[global] = 0;
+        for (uint32_t i = 0; i < rounds; i++) {
+            vmm_switch_page_directory(dirs[i & 1]);
+            cycles[global] += vmm_walk(KERNEL_HEAP_START, size, 1);
+        }
+    }
+    
+    vmm_switch_page_directory(&kernel_page_directory);
+    write_cr4(cr4);
+    irq_restore(flags);
+    
+    pmm_frame_put(VIRT_TO_PHYS(dirs[0]));
+    pmm_frame_put(VIRT_TO_PHYS(dirs[1]));
+    
+    serial_write_string("Switches: ");
+    itoa(rounds, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(", kernel pages touched after each: ");
+    itoa(pages, buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string("\n");
+    
+    serial_write_string("Without global pages: ");
+    itoa(cycles[0] / (rounds * pages), buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" cycles/page\n");
+    
+    serial_write_string("With global pages: ");
+    itoa(cycles[1] / (rounds * pages), buffer, 10);
+    serial_write_string(buffer);
+    serial_write_string(" cycles/page\n");
+    
+    serial_write_string("====================================\n");
+}